@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "Equivalence.hpp"
+#include "util/call_counter.hpp"
+
+/// Maximum number of nodes visited when searching for the automorphisms of
+/// the remaining secrets. If the limit is reached, the automorphisms found
+/// so far are used.
+#define AUTOMORPHISM_SEARCH_LIMIT 20000
+
+/// Maximum number of automorphisms used to filter the candidates.
+#define AUTOMORPHISM_LIMIT 256
+
+namespace Mastermind {
+
+namespace {
+
+// Peg/color permutation that maps the color on peg source[k] of a codeword
+// to peg k, so that the permuted codeword is built peg by peg in order.
+struct Automorphism
+{
+	int8_t source[MM_MAX_PEGS];
+	int8_t color[MM_MAX_COLORS];
+
+	// Returns the packed representation of the permuted codeword.
+	Codeword::compact_type permute(const Codeword &w, int pegs) const
+	{
+		Codeword::compact_type k = 0xffffffff;
+		for (int j = 0; j < pegs; ++j)
+			k = (k << 4) | (Codeword::compact_type)color[w[source[j]]];
+		return k;
+	}
+
+	// Returns true if the permuted codeword is smaller than the codeword.
+	bool maps_to_smaller(const Codeword &w, int pegs) const
+	{
+		for (int j = 0; j < pegs; ++j)
+		{
+			int c = color[w[source[j]]];
+			if (c != w[j])
+				return c < w[j];
+		}
+		return false;
+	}
+};
+
+// Searches for the peg/color permutations that map a set of codewords onto
+// itself. A peg may only map to a peg on which the colors occur the same
+// numbers of times, and a color to a color that occurs on the image of
+// each peg as many times as itself on the peg; the secrets are only
+// permuted once a permutation passes these tests.
+class AutomorphismSearch
+{
+	int _pegs;
+	CodewordConstRange _secrets;
+	std::vector<Codeword::compact_type> _keys; // sorted
+	unsigned int _counts[MM_MAX_COLORS][MM_MAX_PEGS];
+	int _peg_class[MM_MAX_PEGS];
+	int _present[MM_MAX_COLORS];
+	int _npresent;
+	bool _peg_taken[MM_MAX_PEGS];
+	bool _color_taken[MM_MAX_COLORS];
+	size_t _nodes;
+	Automorphism _a;
+
+	bool stop() const
+	{
+		return _nodes > AUTOMORPHISM_SEARCH_LIMIT || found.size() >= AUTOMORPHISM_LIMIT;
+	}
+
+	bool is_identity() const
+	{
+		for (int j = 0; j < _pegs; ++j)
+		{
+			if (_a.source[j] != j)
+				return false;
+		}
+		for (int i = 0; i < _npresent; ++i)
+		{
+			if (_a.color[_present[i]] != _present[i])
+				return false;
+		}
+		return true;
+	}
+
+	bool maps_onto_itself() const
+	{
+		for (CodewordConstIterator it = _secrets.begin(); it != _secrets.end(); ++it)
+		{
+			if (!std::binary_search(_keys.begin(), _keys.end(), _a.permute(*it, _pegs)))
+				return false;
+		}
+		return true;
+	}
+
+	// Assigns an image to the i-th present color.
+	void search_colors(int i)
+	{
+		if (++_nodes, stop())
+			return;
+		if (i == _npresent)
+		{
+			if (!is_identity() && maps_onto_itself())
+				found.push_back(_a);
+			return;
+		}
+
+		const int c = _present[i];
+		for (int t = 0; t < _npresent && !stop(); ++t)
+		{
+			const int d = _present[t];
+			if (_color_taken[d])
+				continue;
+			bool ok = true;
+			for (int j = 0; j < _pegs && ok; ++j)
+				ok = (_counts[d][j] == _counts[c][(int)_a.source[j]]);
+			if (!ok)
+				continue;
+
+			_a.color[c] = (int8_t)d;
+			_color_taken[d] = true;
+			search_colors(i + 1);
+			_color_taken[d] = false;
+		}
+		_a.color[c] = (int8_t)c;
+	}
+
+	// Assigns a source to the j-th peg.
+	void search_pegs(int j)
+	{
+		if (++_nodes, stop())
+			return;
+		if (j == _pegs)
+		{
+			search_colors(0);
+			return;
+		}
+
+		for (int k = 0; k < _pegs && !stop(); ++k)
+		{
+			if (_peg_taken[k] || _peg_class[k] != _peg_class[j])
+				continue;
+			_a.source[j] = (int8_t)k;
+			_peg_taken[k] = true;
+			search_pegs(j + 1);
+			_peg_taken[k] = false;
+		}
+	}
+
+public:
+
+	std::vector<Automorphism> found;
+
+	AutomorphismSearch(int pegs, CodewordConstRange secrets)
+		: _pegs(pegs), _secrets(secrets), _npresent(0), _nodes(0)
+	{
+		_keys.reserve(secrets.size());
+		for (CodewordConstIterator it = secrets.begin(); it != secrets.end(); ++it)
+			_keys.push_back(it->pack());
+		std::sort(_keys.begin(), _keys.end());
+
+		std::fill(&_counts[0][0], &_counts[0][0] + MM_MAX_COLORS * MM_MAX_PEGS, 0);
+		for (CodewordConstIterator it = secrets.begin(); it != secrets.end(); ++it)
+		{
+			for (int j = 0; j < pegs; ++j)
+				++_counts[(*it)[j]][j];
+		}
+
+		// Colors that do not appear in the secrets are left in place; the
+		// color equivalence filter already treats them as equivalent.
+		for (int c = 0; c < MM_MAX_COLORS; ++c)
+		{
+			_a.color[c] = (int8_t)c;
+			_color_taken[c] = false;
+			bool present = false;
+			for (int j = 0; j < pegs; ++j)
+				present = present || (_counts[c][j] != 0);
+			if (present)
+				_present[_npresent++] = c;
+		}
+
+		// Classify the pegs by the sorted counts of the colors on them.
+		std::vector<unsigned int> columns[MM_MAX_PEGS];
+		for (int j = 0; j < pegs; ++j)
+		{
+			for (int i = 0; i < _npresent; ++i)
+				columns[j].push_back(_counts[_present[i]][j]);
+			std::sort(columns[j].begin(), columns[j].end());
+			_peg_class[j] = j;
+			for (int k = 0; k < j; ++k)
+			{
+				if (columns[k] == columns[j])
+				{
+					_peg_class[j] = _peg_class[k];
+					break;
+				}
+			}
+			_a.source[j] = (int8_t)j;
+			_peg_taken[j] = false;
+		}
+	}
+
+	void search()
+	{
+		search_pegs(0);
+	}
+};
+
+} // namespace
+
+/**
+ * Equivalence filter that canonicalizes the candidates by the automorphisms
+ * of the remaining secrets, i.e. the peg/color permutations that map the
+ * set of remaining secrets onto itself.
+ *
+ * Two guesses mapped onto each other by such a permutation partition the
+ * remaining secrets into cells that are mapped onto each other as well,
+ * so the filter keeps a guess only if no automorphism maps it to a smaller
+ * codeword. Unlike the constraint equivalence filter, which only keeps the
+ * permutations that fix each guess made so far, the automorphisms depend
+ * on the responses, and may remain deep in the tree after every
+ * guess-fixing permutation has been ruled out.
+ *
+ * The automorphisms are searched anew for each set of remaining secrets,
+ * up to a limit; any subset of them is valid for filtering.
+ *
+ * @ingroup equiv
+ */
+class AutomorphismEquivalenceFilter : public EquivalenceFilter
+{
+	const Engine *e;
+	std::shared_ptr<const std::vector<Automorphism>> _automorphisms;
+
+public:
+
+	AutomorphismEquivalenceFilter(const Engine *engine)
+		: e(engine), _automorphisms(std::make_shared<std::vector<Automorphism>>())
+	{
+	}
+
+	virtual EquivalenceFilter* clone() const
+	{
+		return new AutomorphismEquivalenceFilter(*this);
+	}
+
+	virtual CodewordList get_canonical_guesses(
+		CodewordConstRange candidates) const
+	{
+		const std::vector<Automorphism> &aa = *_automorphisms;
+		if (aa.empty())
+			return CodewordList(candidates.begin(), candidates.end());
+
+		const int pegs = e->rules().pegs();
+		CodewordList canonical;
+		canonical.reserve(candidates.size());
+		for (CodewordConstIterator it = candidates.begin(); it != candidates.end(); ++it)
+		{
+			bool ok = true;
+			for (size_t i = 0; i < aa.size() && ok; ++i)
+				ok = !aa[i].maps_to_smaller(*it, pegs);
+			if (ok)
+				canonical.push_back(*it);
+		}
+
+		UPDATE_CALL_COUNTER("AutomorphismEquivalence_Input", candidates.size());
+		UPDATE_CALL_COUNTER("AutomorphismEquivalence_Output", canonical.size());
+		return canonical;
+	}
+
+	virtual void add_constraint(
+		const Codeword & /* guess */,
+		Feedback /* response */,
+		CodewordConstRange remaining)
+	{
+		std::shared_ptr<std::vector<Automorphism>> aa =
+			std::make_shared<std::vector<Automorphism>>();
+		if (!remaining.empty())
+		{
+			AutomorphismSearch search(e->rules().pegs(), remaining);
+			search.search();
+			aa->swap(search.found);
+		}
+		_automorphisms = aa;
+		UPDATE_CALL_COUNTER("AutomorphismEquivalence_Automorphisms", aa->size());
+	}
+};
+
+EquivalenceFilter* CreateAutomorphismEquivalenceFilter(const Engine *e)
+{
+	return new AutomorphismEquivalenceFilter(e);
+}
+
+} // namespace Mastermind
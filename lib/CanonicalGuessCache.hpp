@@ -0,0 +1,85 @@
+#ifndef MASTERMIND_CANONICAL_GUESS_CACHE_HPP
+#define MASTERMIND_CANONICAL_GUESS_CACHE_HPP
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "Engine.hpp"
+#include "Equivalence.hpp"
+#include "util/call_counter.hpp"
+
+namespace Mastermind {
+
+/**
+ * Cache of the canonical guesses among all codewords, keyed by the
+ * signature of the state of an equivalence filter.
+ *
+ * Many nodes of a strategy tree share the same filter state, for example
+ * once the constraints have fixed every peg permutation and the same
+ * colors are excluded. The canonical guesses of such a state are then
+ * filtered from the universe only once.
+ *
+ * The cache holds a bounded number of codewords. The lists of the states
+ * met after the cache is full are not stored; since the first states met
+ * in a build are the shallow ones, which repeat the most, these stay in
+ * the cache.
+ *
+ * The cache may be accessed concurrently from multiple threads.
+ *
+ * @ingroup equiv
+ */
+class CanonicalGuessCache
+{
+	typedef std::shared_ptr<const CodewordList> list_ptr;
+
+	const Engine *_e;
+	size_t _capacity; // maximum number of codewords stored
+	size_t _size;     // number of codewords stored
+	std::unordered_map<std::string, list_ptr> _lists;
+
+public:
+
+	/// Creates a cache that holds at most @c capacity codewords.
+	CanonicalGuessCache(const Engine *e, size_t capacity)
+		: _e(e), _capacity(capacity), _size(0) { }
+
+	/// Returns the canonical guesses of a filter among all codewords.
+	CodewordList get_canonical_guesses(const EquivalenceFilter *filter)
+	{
+		std::string sig;
+		if (!filter->signature(sig))
+			return filter->generate_canonical_guesses(_e);
+
+		list_ptr list;
+#if _OPENMP
+		#pragma omp critical (CanonicalGuessCache)
+#endif
+		{
+			auto it = _lists.find(sig);
+			if (it != _lists.end())
+				list = it->second;
+		}
+		UPDATE_CALL_COUNTER("CanonicalGuessCache_Hit", list ? 1 : 0);
+		if (list)
+			return *list;
+
+		list = std::make_shared<const CodewordList>(
+			filter->generate_canonical_guesses(_e));
+#if _OPENMP
+		#pragma omp critical (CanonicalGuessCache)
+#endif
+		{
+			if (_size + list->size() <= _capacity &&
+				_lists.insert(std::make_pair(sig, list)).second)
+			{
+				_size += list->size();
+			}
+		}
+		return *list;
+	}
+};
+
+} // namespace Mastermind
+
+#endif // MASTERMIND_CANONICAL_GUESS_CACHE_HPP
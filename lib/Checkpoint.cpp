@@ -0,0 +1,147 @@
+#include <cstdio>
+#include <sstream>
+
+#include "Checkpoint.hpp"
+
+namespace Mastermind {
+
+std::string Checkpoint::header() const
+{
+	std::ostringstream os;
+	os << "MMCK " << _rules.pegs() << ' ' << _rules.colors() << ' '
+		<< (_rules.repeatable()? 1 : 0) << ' ' << (int)_obj << ' '
+		<< (int)_constraints.max_depth << ' ' << (_constraints.pos_only? 1 : 0)
+		<< ' ' << (_constraints.use_obvious? 1 : 0);
+	return os.str();
+}
+
+void Checkpoint::write_entry(std::ostream &os, key_type key, const Entry &entry)
+{
+	os << (entry.exact? 'X' : 'F') << ' ' << std::hex << key << std::dec
+		<< ' ' << entry.cost.steps << ' ' << entry.cost.depth << ' '
+		<< entry.cost.worst;
+	if (entry.exact)
+		os << ' ' << std::hex << entry.guess << std::dec;
+	os << std::endl;
+}
+
+void Checkpoint::merge(key_type key, const Entry &entry)
+{
+	// Keep an exact entry, or the tighter of two thresholds.
+	std::unordered_map<key_type, Entry>::iterator it = _table.find(key);
+	if (it == _table.end())
+	{
+		_table.insert(std::make_pair(key, entry));
+	}
+	else if (!it->second.exact && (entry.exact ||
+		superior(it->second.cost, entry.cost, _obj)))
+	{
+		it->second = entry;
+	}
+}
+
+bool Checkpoint::load(const std::string &filename)
+{
+	// The last line is skipped if it is not terminated, which happens if
+	// the search was interrupted while writing it.
+	std::ifstream is(filename.c_str());
+	if (!is)
+		return false;
+
+	std::string line;
+	if (std::getline(is, line) && line != header())
+		return false;
+
+	while (std::getline(is, line) && !is.eof())
+	{
+		std::istringstream ss(line);
+		char type;
+		key_type key;
+		unsigned int steps, depth, worst;
+		if (!(ss >> type >> std::hex >> key >> std::dec >> steps >> depth >> worst))
+			break;
+
+		Entry entry;
+		entry.exact = (type == 'X');
+		entry.cost = StrategyCost(steps, (unsigned short)depth, (unsigned short)worst);
+		entry.guess = 0;
+		if (entry.exact)
+			ss >> std::hex >> entry.guess >> std::dec;
+		else if (type != 'F')
+		{
+			break;
+		}
+		if (!ss)
+			break;
+		merge(key, entry);
+	}
+	return true;
+}
+
+bool Checkpoint::open(const std::string &filename)
+{
+	// Load the entries of an existing journal.
+	if (std::ifstream(filename.c_str()) && !load(filename))
+		return false;
+
+	// Rewrite the journal with the loaded entries, and replace the file
+	// only after the new one is complete.
+	std::string temp = filename + ".tmp";
+	{
+		std::ofstream os(temp.c_str());
+		os << header() << std::endl;
+		for (std::unordered_map<key_type, Entry>::const_iterator it = _table.begin();
+			it != _table.end(); ++it)
+		{
+			write_entry(os, it->first, it->second);
+		}
+		if (!os)
+			return false;
+	}
+	if (std::rename(temp.c_str(), filename.c_str()) != 0)
+	{
+		std::remove(filename.c_str());
+		if (std::rename(temp.c_str(), filename.c_str()) != 0)
+			return false;
+	}
+
+	_os.open(filename.c_str(), std::ios::app);
+	return !!_os;
+}
+
+bool Checkpoint::lookup(key_type key, Entry &entry) const
+{
+	std::unordered_map<key_type, Entry>::const_iterator it = _table.find(key);
+	if (it == _table.end())
+		return false;
+	entry = it->second;
+	return true;
+}
+
+void Checkpoint::record(key_type key, const StrategyCost &cost, const Codeword &guess)
+{
+	Entry entry;
+	entry.exact = true;
+	entry.cost = cost;
+	entry.guess = guess.pack();
+
+#if _OPENMP
+	#pragma omp critical (Checkpoint)
+#endif
+	write_entry(_os, key, entry);
+}
+
+void Checkpoint::record_failure(key_type key, const StrategyCost &threshold)
+{
+	Entry entry;
+	entry.exact = false;
+	entry.cost = threshold;
+	entry.guess = 0;
+
+#if _OPENMP
+	#pragma omp critical (Checkpoint)
+#endif
+	write_entry(_os, key, entry);
+}
+
+} // namespace Mastermind
@@ -0,0 +1,119 @@
+#ifndef MASTERMIND_CHECKPOINT_HPP
+#define MASTERMIND_CHECKPOINT_HPP
+
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+#include "Rules.hpp"
+#include "Codeword.hpp"
+#include "Strategy.hpp"
+#include "TranspositionTable.hpp"
+
+namespace Mastermind {
+
+/**
+ * Journal of the subproblems solved by an optimal strategy search, which
+ * allows an interrupted search to be resumed.
+ *
+ * The results of the subproblems near the root of the search are appended
+ * to the journal file as soon as they are solved. A subproblem is identified
+ * by the same key as in the transposition table. For each subproblem, the
+ * journal stores either the optimal cost together with the optimal guess,
+ * or the threshold that the search failed against.
+ *
+ * When a search is resumed, it replays the same steps as the interrupted
+ * one, but uses the journaled results in place of solving the subproblems
+ * again. Since the search is deterministic, the strategy found is the same
+ * as that of an uninterrupted search. The states below a journaled guess
+ * are solved again when the strategy tree is built, but only along the
+ * optimal strategy.
+ *
+ * The journal may be written to concurrently from multiple threads. The
+ * entries loaded from the file are read-only during the search.
+ *
+ * @ingroup Optimal
+ */
+class Checkpoint
+{
+public:
+
+	/// Type of the key of a subproblem.
+	typedef TranspositionTable::key_type key_type;
+
+	/// Entry of the journal.
+	struct Entry
+	{
+		/// Whether the cost is the optimal cost of the subproblem, or the
+		/// threshold that the search failed against.
+		bool exact;
+
+		/// Optimal cost of the subproblem, or the threshold failed against.
+		StrategyCost cost;
+
+		/// Optimal guess of the subproblem if exact.
+		Codeword::compact_type guess;
+	};
+
+private:
+
+	Rules _rules;
+	StrategyObjective _obj;
+	StrategyConstraints _constraints;
+	std::unordered_map<key_type, Entry> _table;
+	std::ofstream _os;
+
+	// Keeps the entry that carries more information.
+	void merge(key_type key, const Entry &entry);
+
+	// Writes an entry as a line of the journal file.
+	static void write_entry(std::ostream &os, key_type key, const Entry &entry);
+
+public:
+
+	/// Creates an empty journal for a search with the given parameters.
+	Checkpoint(const Rules &rules, StrategyObjective obj, StrategyConstraints c)
+		: _rules(rules), _obj(obj), _constraints(c) { }
+
+	/// Returns the number of entries loaded from the journal files.
+	size_t size() const { return _table.size(); }
+
+	/// Returns the header line of the journal file, which identifies the
+	/// parameters of the search.
+	std::string header() const;
+
+	/**
+	 * Loads the entries of a journal file created for the same search
+	 * parameters, without opening it for writing. This merges the results
+	 * of searches run elsewhere, e.g. by other processes.
+	 *
+	 * @returns @c true if the file was loaded, @c false if it cannot be
+	 *      read or belongs to a different search.
+	 */
+	bool load(const std::string &filename);
+
+	/**
+	 * Opens a journal file. The entries of an existing file are loaded if
+	 * the file was created for the same search parameters. The file is then
+	 * rewritten with the loaded entries, dropping any incomplete line left
+	 * by an interruption, and new entries are appended to it.
+	 *
+	 * @returns @c true if the file is ready for writing, @c false otherwise.
+	 */
+	bool open(const std::string &filename);
+
+	/// Looks up the journaled result of a subproblem. Returns @c true and
+	/// copies the entry to @c entry if found, or returns @c false otherwise.
+	bool lookup(key_type key, Entry &entry) const;
+
+	/// Appends the optimal cost and guess of a subproblem to the journal.
+	/// Nothing is written if the journal is not open.
+	void record(key_type key, const StrategyCost &cost, const Codeword &guess);
+
+	/// Appends the threshold a subproblem failed against to the journal.
+	void record_failure(key_type key, const StrategyCost &threshold);
+};
+
+} // namespace Mastermind
+
+#endif // MASTERMIND_CHECKPOINT_HPP
@@ -1,6 +1,12 @@
 #include <vector>
 #include "CodeBreaker.hpp"
 #include "ObviousStrategy.hpp"
+#include "CanonicalGuessCache.hpp"
+
+/// Maximum number of codewords in the cache of canonical guesses shared
+/// by the nodes of a strategy tree being built. Define to zero to filter
+/// the candidates at every node.
+#define CANONICAL_GUESS_CACHE_SIZE (1 << 20)
 
 namespace Mastermind {
 
@@ -10,7 +16,8 @@ Codeword MakeGuess(
 	CodewordConstRange secrets,
 	Strategy *strat,
 	const EquivalenceFilter *filter,
-	const CodeBreakerOptions &options)
+	const CodeBreakerOptions &options,
+	CanonicalGuessCache *cache)
 {
 	size_t count = secrets.size();
 	if (count == 0)
@@ -34,8 +41,12 @@ Codeword MakeGuess(
 	CodewordConstRange candidates = options.possibility_only ?
 		secrets : e->universe();
 
-	// Filter the candidate set to remove "equivalent" guesses.
-	CodewordList canonical = filter->get_canonical_guesses(candidates);
+	// Filter the candidate set to remove "equivalent" guesses. If the
+	// candidates are all codewords, other nodes with the same filter state
+	// may have filtered them already.
+	CodewordList canonical = (cache && !options.possibility_only)?
+		cache->get_canonical_guesses(filter) :
+		filter->get_canonical_guesses(candidates);
 
 	// Make a guess using the strategy provided.
 	Codeword guess = strat->make_guess(secrets, canonical);
@@ -59,10 +70,11 @@ static void FillStrategy(
 	Strategy *strat,
 	const EquivalenceFilter *filter,
 	const CodeBreakerOptions &options,
+	CanonicalGuessCache *cache,
 	int *progress)
 {
 	// Make a guess.
-	Codeword guess = MakeGuess(e, secrets, strat, filter, options);
+	Codeword guess = MakeGuess(e, secrets, strat, filter, options, cache);
 	if (guess.IsEmpty())
 		return;
 
@@ -101,7 +113,7 @@ static void FillStrategy(
 
 			// Recursively build the strategy tree.
 			FillStrategy(subtree, subtree.root(), e, depth + 1, cell, strat, 
-				new_filter.get(), options, progress);
+				new_filter.get(), options, cache, progress);
 		}
 
 		// Add the subtree to the big tree.
@@ -124,8 +136,13 @@ StrategyTree BuildStrategyTree(
 
 	StrategyTree tree(e->rules());
 
+	std::unique_ptr<CanonicalGuessCache> cache;
+	if (CANONICAL_GUESS_CACHE_SIZE > 0)
+		cache.reset(new CanonicalGuessCache(e, CANONICAL_GUESS_CACHE_SIZE));
+
 	int progress = 0;
-	FillStrategy(tree, tree.root(), e, 0, all, strat, filter, options, &progress);
+	FillStrategy(tree, tree.root(), e, 0, all, strat, filter, options,
+		cache.get(), &progress);
 	return tree;
 }
 
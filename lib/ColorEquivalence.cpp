@@ -1,12 +1,30 @@
 #include <numeric>
+#include <cstring>
+#include <vector>
+#include <algorithm>
 
 #include "Algorithm.hpp"
 #include "Equivalence.hpp"
 #include "util/intrinsic.hpp"
 #include "util/call_counter.hpp"
+#include "util/simd.hpp"
+
+/// Define SYMMETRIC_COLORS to 1 to treat as equivalent, under rules that
+/// allow repeated colors, the colors that can be swapped with each other
+/// without changing the set of remaining secrets, in addition to the
+/// excluded colors.
+#define SYMMETRIC_COLORS 1
 
 namespace Mastermind {
 
+typedef util::simd::simd_t<uint8_t,16> simd_t;
+
+// Loads a vector from 16 bytes.
+static inline simd_t load_bytes(const uint8_t bytes[16])
+{
+	return _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+}
+
 /// Represents a color equivalence filter.
 class ColorEquivalenceFilter : public EquivalenceFilter
 {
@@ -14,14 +32,24 @@ class ColorEquivalenceFilter : public EquivalenceFilter
 	ColorMask _unguessed;
 	ColorMask _excluded;
 
+	// For each color, the smaller colors that are interchangeable with it.
+	// In a canonical codeword, these colors all appear before the first
+	// occurrence of the color. Only used under repeatable rules.
+	ColorMask::value_type _preceding[MM_MAX_COLORS];
+	bool _symmetric; // whether any color has a preceding color
+
 	CodewordList filter_norep(CodewordConstRange candidates) const;
 	CodewordList filter_rep(CodewordConstRange candidates) const;
+	CodewordList filter_symmetric(CodewordConstRange candidates) const;
+	void find_symmetric_colors(CodewordConstRange remaining);
 
 public:
 
 	ColorEquivalenceFilter(const Engine *engine)
-		: e(engine), _unguessed(ColorMask::fill(e->rules().colors()))
+		: e(engine), _unguessed(ColorMask::fill(e->rules().colors())),
+		_symmetric(false)
 	{
+		std::fill(_preceding, _preceding + MM_MAX_COLORS, 0);
 	}
 
 	virtual EquivalenceFilter* clone() const
@@ -47,6 +75,8 @@ public:
 #endif
 	}
 
+	virtual CodewordList generate_canonical_guesses(const Engine *engine) const;
+
 	virtual void add_constraint(
 		const Codeword & guess,
 		Feedback /* response */,
@@ -56,47 +86,290 @@ public:
 		_excluded.reset(e->colorMask(remaining));
 		_unguessed.reset(e->colorMask(guess));
 		_unguessed.reset(_excluded);
+#if SYMMETRIC_COLORS
+		if (e->rules().repeatable())
+			find_symmetric_colors(remaining);
+#endif
+	}
+
+	virtual bool signature(std::string &sig) const
+	{
+		// The canonical guesses only depend on the excluded colors and
+		// the interchangeable colors.
+		ColorMask::value_type excluded = _excluded.value();
+		sig += 'C';
+		sig.append(reinterpret_cast<const char *>(&excluded), sizeof(excluded));
+		sig.append(reinterpret_cast<const char *>(_preceding), sizeof(_preceding));
+		return true;
 	}
 };
 
+// Two colors are interchangeable if swapping them maps the set of remaining
+// secrets onto itself; the guesses that differ by such a swap then
+// partition the secrets into cells of the same sizes, whose strategies are
+// the same up to the swap. Since the swaps that preserve a set are closed
+// under conjugation, the colors fall into classes of interchangeable
+// colors, and a color only needs to be tested against the smallest color
+// of each class. The colors that do not appear in any guess so far are
+// always interchangeable; the others are first compared by the number of
+// secrets that have them on each peg. A class made only of such unguessed
+// colors is left alone, since the constraint filter already treats the
+// unguessed colors as interchangeable.
+void ColorEquivalenceFilter::find_symmetric_colors(CodewordConstRange remaining)
+{
+	const int pegs = e->rules().pegs();
+	const int colors = e->rules().colors();
+
+	std::fill(_preceding, _preceding + MM_MAX_COLORS, 0);
+	_symmetric = false;
+
+	// Nothing to do unless a guessed color may be swapped with another.
+	const ColorMask::value_type present = (ColorMask::value_type)
+		(ColorMask::fill(colors).value() & ~_excluded.value());
+	const ColorMask::value_type guessed = present & ~_unguessed.value();
+	if (guessed == 0 || (guessed == present && (guessed & (guessed - 1)) == 0))
+		return;
+
+	// Count the occurrences of each color by summing the color counters
+	// of the secrets, 32 at a time so that the bytes do not overflow.
+	unsigned int totals[MM_MAX_COLORS] = { 0 };
+	const size_t n = remaining.size();
+	for (size_t i = 0; i < n; )
+	{
+		simd_t sum = simd_t::zero();
+		for (size_t end = std::min(n, i + 32); i < end; ++i)
+			sum = sum + *reinterpret_cast<const simd_t *>(&remaining.begin()[i]);
+		uint8_t sum_bytes[16];
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(sum_bytes), sum);
+		for (int c = 0; c < colors; ++c)
+			totals[c] += sum_bytes[c];
+	}
+
+	// The number of occurrences of each color on each peg, only counted
+	// if two colors have the same total.
+	unsigned int counts[MM_MAX_COLORS][MM_MAX_PEGS];
+	bool counted = false;
+
+	// The keys of the secrets, sorted for lookup, only computed if two
+	// colors have the same counts on every peg.
+	std::vector<unsigned int> keys;
+	auto key = [pegs](const Codeword &w, int a, int b) -> unsigned int
+	{
+		unsigned int k = 0;
+		for (int j = 0; j < pegs; ++j)
+		{
+			int c = w[j];
+			k = (k << 4) | (c == a ? b : c == b ? a : c);
+		}
+		return k;
+	};
+	auto swappable = [&](int a, int b) -> bool
+	{
+		if (totals[a] != totals[b])
+			return false;
+		if (!counted)
+		{
+			std::memset(counts, 0, sizeof(counts));
+			for (CodewordConstIterator it = remaining.begin(); it != remaining.end(); ++it)
+			{
+				for (int j = 0; j < pegs; ++j)
+					++counts[(*it)[j]][j];
+			}
+			counted = true;
+		}
+		for (int j = 0; j < pegs; ++j)
+		{
+			if (counts[a][j] != counts[b][j])
+				return false;
+		}
+		if (keys.empty())
+		{
+			keys.reserve(remaining.size());
+			for (CodewordConstIterator it = remaining.begin(); it != remaining.end(); ++it)
+				keys.push_back(key(*it, -1, -1));
+			std::sort(keys.begin(), keys.end());
+		}
+		for (CodewordConstIterator it = remaining.begin(); it != remaining.end(); ++it)
+		{
+			if (it->count(a) == 0 && it->count(b) == 0)
+				continue;
+			if (!std::binary_search(keys.begin(), keys.end(), key(*it, a, b)))
+				return false;
+		}
+		return true;
+	};
+
+	int first[MM_MAX_COLORS]; // smallest color of each class
+	ColorMask::value_type members[MM_MAX_COLORS]; // colors in each class
+	int nclasses = 0;
+	for (int c = 0; c < colors; ++c)
+	{
+		if (_excluded[c])
+			continue;
+
+		int i = 0;
+		while (i < nclasses && !(_unguessed[c] && _unguessed[first[i]]) &&
+			!swappable(first[i], c))
+			++i;
+
+		if (i == nclasses)
+		{
+			first[nclasses] = c;
+			members[nclasses++] = 0;
+		}
+		members[i] |= (ColorMask::value_type)(1 << c);
+	}
+
+	for (int i = 0; i < nclasses; ++i)
+	{
+		ColorMask::value_type m = members[i];
+		if ((m & ~_unguessed.value()) == 0 || (m & (m - 1)) == 0)
+			continue;
+		for (int c = first[i] + 1; c < colors; ++c)
+		{
+			if (m & (1 << c))
+				_preceding[c] = (ColorMask::value_type)(m & ((1 << c) - 1));
+		}
+		_symmetric = true;
+	}
+}
+
 CodewordList ColorEquivalenceFilter::filter_rep(
 	CodewordConstRange candidates) const
 {
-	// For codewords with repeated colors, we only apply color equivalence
-	// on excluded colors.
+	if (_symmetric)
+		return filter_symmetric(candidates);
+
+	// Without interchangeable colors, we only apply color equivalence on
+	// excluded colors.
 	if (_excluded.empty())
 		return CodewordList(candidates.begin(), candidates.end());
 
 	int first = _excluded.smallest();
 
-	// Find out the minimum equivalent codeword of each codeword. If it is
-	// equal to the codeword itself, keep it.
+	// A codeword is canonical if it contains no excluded color other than
+	// the smallest one. Select the counters of these colors, which occupy
+	// the first bytes of the codeword, and test them all at once.
+	uint8_t mask_bytes[16] = { 0 };
+	for (int c = first + 1; c < MM_MAX_COLORS; ++c)
+		mask_bytes[c] = _excluded[c]? 0xff : 0;
+	const simd_t mask = load_bytes(mask_bytes);
+	const simd_t zero = simd_t::zero();
+
+	const size_t n = candidates.size();
+	CodewordList canonical;
+	canonical.reserve(n);
+	for (size_t i = 0; i < n; ++i)
+	{
+		const Codeword &guess = candidates.begin()[i];
+		const simd_t w = *reinterpret_cast<const simd_t *>(&guess);
+		if (util::simd::byte_mask((w & mask) == zero) == 0xffff)
+			canonical.push_back(guess);
+	}
+	return canonical;
+}
+
+CodewordList ColorEquivalenceFilter::filter_symmetric(
+	CodewordConstRange candidates) const
+{
+	// A codeword is canonical if the colors interchangeable with each
+	// color all appear before it, and if it contains no excluded color
+	// other than the smallest one.
+	//
+	// This keeps the lexicographically smallest codeword of each class,
+	// which is not the first one scored when the candidates are not in
+	// lexicographic order (as with -po, where they come in partition
+	// order). The cost of the strategy is unchanged, but ties between
+	// equally good guesses may then be broken differently.
+	const int first = _excluded.empty() ? MM_MAX_COLORS : _excluded.smallest();
+	const int pegs = e->rules().pegs();
 	CodewordList canonical;
 	canonical.reserve(candidates.size());
+
+#if __SSSE3__
+	// Equivalently, each color that appears must first appear after the
+	// largest color smaller than it in its class; an excluded color other
+	// than the smallest one must first appear after a color that never
+	// does. Find the position of the first occurrence of each color,
+	// with NoPeg for a color that does not appear, and look up the first
+	// occurrence of the preceding color with a shuffle. The last byte,
+	// which no color maps to, stands for a color that never appears, and
+	// an index of 0x80 for no preceding color at all.
+	const uint8_t NoPeg = 0x7f;
+	uint8_t preceding_bytes[16], none_bytes[16] = { 0 };
+	for (int c = 0; c < 16; ++c)
+	{
+		preceding_bytes[c] = 0x80;
+		if (c < MM_MAX_COLORS && _excluded[c] && c > first)
+			preceding_bytes[c] = 15;
+		else if (c < MM_MAX_COLORS && _preceding[c] != 0)
+			preceding_bytes[c] = (uint8_t)util::intrinsic::bit_scan_reverse(_preceding[c]);
+		else
+			none_bytes[c] = 0xff;
+	}
+	const simd_t preceding_table = load_bytes(preceding_bytes);
+	const simd_t none = load_bytes(none_bytes);
+
+	uint8_t color_bytes[16];
+	for (int c = 0; c < 16; ++c)
+		color_bytes[c] = (uint8_t)c;
+	const simd_t color_index = load_bytes(color_bytes);
+	const simd_t no_peg(NoPeg);
+	simd_t digit_index[MM_MAX_PEGS], peg_offset[MM_MAX_PEGS];
+	for (int j = 0; j < pegs; ++j)
+	{
+		digit_index[j] = simd_t((uint8_t)(MM_MAX_COLORS + j));
+		peg_offset[j] = simd_t((uint8_t)(j - NoPeg));
+	}
+
+	const size_t n = candidates.size();
+	for (size_t i = 0; i < n; ++i)
+	{
+		const Codeword &guess = candidates.begin()[i];
+		const simd_t w = *reinterpret_cast<const simd_t *>(&guess);
+		simd_t pos = no_peg;
+		for (int j = 0; j < pegs; ++j)
+		{
+			simd_t at_peg = (util::simd::shuffle(w, digit_index[j]) == color_index);
+			pos = util::simd::min(pos, no_peg + (at_peg & peg_offset[j]));
+		}
+		const util::simd::xmm_i8 before(util::simd::shuffle(pos, preceding_table) | none);
+		int ok = util::simd::byte_mask(util::simd::xmm_i8(pos) > before)
+			| util::simd::byte_mask(pos == no_peg);
+		if (ok == 0xffff)
+			canonical.push_back(guess);
+	}
+#else
+	// A color that fails the test fails it on its first occurrence, so
+	// every peg may be tested alike. An excluded color other than the
+	// smallest one is required to appear before itself.
+	ColorMask::value_type required[MM_MAX_COLORS];
+	for (int c = 0; c < MM_MAX_COLORS; ++c)
+	{
+		required[c] = (_excluded[c] && c > first) ?
+			(ColorMask::value_type)(1 << c) : _preceding[c];
+	}
+
 	for (CodewordConstIterator it = candidates.begin(); it != candidates.end(); ++it)
 	{
-		Codeword guess = *it;
-		bool ok = true;
-		for (int j = 0; j < e->rules().pegs(); j++)
+		const Codeword &guess = *it;
+		unsigned int seen = 0, missing = 0;
+		for (int j = 0; j < pegs; ++j)
 		{
 			int c = guess[j];
-			if (_excluded[c] && c > first)
-			{
-				ok = false;
-				break;
-			}
+			missing |= required[c] & ~seen;
+			seen |= 1u << c;
 		}
-		if (ok)
-		{
+		if (missing == 0)
 			canonical.push_back(guess);
-		}
 	}
+#endif
+
+	UPDATE_CALL_COUNTER("ColorEquivalence_Input", candidates.size());
+	UPDATE_CALL_COUNTER("ColorEquivalence_Output", canonical.size());
 	return canonical;
 }
 
-// @todo
-// 1) clean up the code
-// 2) we might use SSE2 to speed up part of the code
 CodewordList ColorEquivalenceFilter::filter_norep(
 	CodewordConstRange candidates) const
 {
@@ -106,6 +379,47 @@ CodewordList ColorEquivalenceFilter::filter_norep(
 	if (_excluded.empty_or_unique())
 		return CodewordList(candidates.begin(), candidates.end());
 
+#if __SSSE3__
+	// Equivalently, the excluded colors must appear in increasing order,
+	// starting from the smallest one; that is, the rank of the color among
+	// the excluded colors must equal the number of excluded colors on the
+	// preceding pegs. Look up the rank of each peg's color with a shuffle,
+	// and count the excluded colors on the preceding pegs with a prefix
+	// sum. Colors that are not excluded have no rank.
+	const uint8_t NoRank = 0x7f;
+	uint8_t rank_bytes[16];
+	std::memset(rank_bytes, NoRank, sizeof(rank_bytes));
+	for (int c = 0, r = 0; c < MM_MAX_COLORS; ++c)
+	{
+		if (_excluded[c])
+			rank_bytes[c] = (uint8_t)r++;
+	}
+	const simd_t rank_table = load_bytes(rank_bytes);
+	const util::simd::xmm_i8 no_rank((int8_t)NoRank);
+	const int peg_mask = (1 << e->rules().pegs()) - 1;
+
+	const size_t n = candidates.size();
+	CodewordList canonical;
+	canonical.reserve(n);
+	for (size_t i = 0; i < n; ++i)
+	{
+		const Codeword &guess = candidates.begin()[i];
+		const simd_t w = *reinterpret_cast<const simd_t *>(&guess);
+		const simd_t digits = util::simd::shift_elements_right<MM_MAX_COLORS>(w);
+		const simd_t rank = util::simd::shuffle(rank_table, digits);
+		const simd_t excluded(no_rank > util::simd::xmm_i8(rank));
+
+		simd_t before = util::simd::shift_elements_left<1>(excluded & simd_t(1));
+		before = before + util::simd::shift_elements_left<1>(before);
+		before = before + util::simd::shift_elements_left<2>(before);
+		before = before + util::simd::shift_elements_left<4>(before);
+
+		int mismatch = util::simd::byte_mask(excluded)
+			& ~util::simd::byte_mask(rank == before);
+		if ((mismatch & peg_mask) == 0)
+			canonical.push_back(guess);
+	}
+#else
 	// Find out the minimum equivalent codeword of each codeword. If it is
 	// equal to the codeword itself, keep it.
 	CodewordList canonical;
@@ -163,6 +477,7 @@ CodewordList ColorEquivalenceFilter::filter_norep(
 			canonical.push_back(guess);
 		}
 	}
+#endif
 
 #if 1
 	UPDATE_CALL_COUNTER("ColorEquivalence_Input", candidates.size());
@@ -174,6 +489,54 @@ CodewordList ColorEquivalenceFilter::filter_norep(
 	return canonical;
 }
 
+// Generates the canonical guesses peg by peg. The color on each new peg
+// is tested as in filter_rep() and filter_norep(); since the tests only
+// look at the preceding pegs, a prefix that fails is never extended.
+CodewordList ColorEquivalenceFilter::generate_canonical_guesses(
+	const Engine * /* engine */) const
+{
+	CodewordList canonical;
+	if (e->rules().repeatable())
+	{
+		if (_excluded.empty() && !_symmetric)
+			return CodewordList(e->universe().begin(), e->universe().end());
+
+		// The colors interchangeable with a new color must all appear on
+		// the preceding pegs.
+		const int first = _excluded.empty() ? MM_MAX_COLORS : _excluded.smallest();
+		generate_codewords(e->rules(), [this, first](const Codeword &prefix, int k)
+		{
+			int c = prefix[k-1];
+			if (_excluded[c] && c > first)
+				return false;
+			if (_preceding[c] == 0 || prefix.count(c) > 1)
+				return true;
+			return (_preceding[c] & ~e->colorMask(prefix).value()) == 0;
+		}, canonical);
+	}
+	else
+	{
+		if (_excluded.empty_or_unique())
+			return CodewordList(e->universe().begin(), e->universe().end());
+
+		// An excluded color must be the smallest excluded color that does
+		// not appear on the preceding pegs.
+		generate_codewords(e->rules(), [this](const Codeword &prefix, int k)
+		{
+			int c = prefix[k-1];
+			if (!_excluded[c])
+				return true;
+			ColorMask smaller = _excluded & ColorMask((ColorMask::value_type)((1 << c) - 1));
+			for (int j = 0; j < k - 1; ++j)
+				smaller.reset(prefix[j]);
+			return smaller.empty();
+		}, canonical);
+	}
+
+	UPDATE_CALL_COUNTER("ColorEquivalence_Generated", canonical.size());
+	return canonical;
+}
+
 EquivalenceFilter* CreateColorEquivalenceFilter(const Engine *e)
 {
 	return new ColorEquivalenceFilter(e);
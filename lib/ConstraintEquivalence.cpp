@@ -1,7 +1,10 @@
 #include <iostream>
 #include <cassert>
+#include <cstring>
+#include <memory>
 #include <vector>
 #include <algorithm>
+#include <numeric>
 
 #include "Engine.hpp"
 #include "Permutation.hpp"
@@ -10,16 +13,345 @@
 #include "util/intrinsic.hpp"
 #include "util/call_counter.hpp"
 #include "util/bitmask.hpp"
+#include "util/simd.hpp"
 
 namespace Mastermind {
 
+/// Maximum number of nodes visited when searching for a symmetry that maps
+/// one set of codewords onto another. If the limit is reached, the sets are
+/// treated as not symmetric.
+#define SYMMETRY_SEARCH_LIMIT 100000
+
+namespace {
+
+/**
+ * Backtracking search for a permutation that maps each codeword of a set
+ * into a target set. The peg permutation and the colors of the guesses
+ * are fixed; the free colors are assigned as they are first met, by trying
+ * each target codeword as the image of a codeword with unassigned colors.
+ */
+class SymmetrySearch
+{
+	int _pegs;
+	CodewordConstRange _from;
+	const std::vector<Codeword::compact_type> &_to; // sorted
+	ColorMask _free;                  // colors that may be permuted
+	bool _assigned[MM_MAX_COLORS];    // whether a color has an image
+	bool _taken[MM_MAX_COLORS];       // whether a color is an image
+	size_t _nodes;
+
+public:
+
+	CodewordPermutation perm;
+
+	SymmetrySearch(int pegs, int colors, CodewordConstRange from,
+		const std::vector<Codeword::compact_type> &to,
+		const CodewordPermutation &p, ColorMask free_colors)
+		: _pegs(pegs), _from(from), _to(to), _free(free_colors),
+		_nodes(0), perm(p)
+	{
+		for (int c = 0; c < MM_MAX_COLORS; ++c)
+		{
+			_assigned[c] = (c >= colors) || !_free[c];
+			_taken[c] = false;
+		}
+	}
+
+	/// Maps the k-th and subsequent codewords. Returns @c true if all of
+	/// them are mapped into the target set.
+	bool search(size_t k)
+	{
+		if (++_nodes > SYMMETRY_SEARCH_LIMIT)
+			return false;
+		if (k == _from.size())
+			return true;
+
+		const Codeword w = _from[k];
+		bool complete = true;
+		for (int i = 0; i < _pegs; ++i)
+			complete = complete && _assigned[w[i]];
+		if (complete)
+		{
+			return std::binary_search(_to.begin(), _to.end(),
+				perm.permute(w).pack()) && search(k + 1);
+		}
+
+		for (size_t j = 0; j < _to.size(); ++j)
+		{
+			const Codeword t = Codeword::unpack(_to[j]);
+			int fresh[MM_MAX_PEGS];
+			int nfresh = 0;
+			bool ok = true;
+			for (int i = 0; i < _pegs && ok; ++i)
+			{
+				int c = w[i], d = t[perm.peg[i]];
+				if (_assigned[c])
+				{
+					ok = (perm.color[c] == d);
+				}
+				else if (!_free[d] || _taken[d])
+				{
+					ok = false;
+				}
+				else
+				{
+					perm.color[c] = (int8_t)d;
+					_assigned[c] = _taken[d] = true;
+					fresh[nfresh++] = c;
+				}
+			}
+			if (ok && search(k + 1))
+				return true;
+			for (int i = 0; i < nfresh; ++i)
+			{
+				_assigned[fresh[i]] = false;
+				_taken[(int)perm.color[fresh[i]]] = false;
+			}
+		}
+		return false;
+	}
+
+	/// Maps the free colors that are still unassigned to the free colors
+	/// that are not yet taken, so that the permutation is complete.
+	void complete(int colors)
+	{
+		int d = 0;
+		for (int c = 0; c < colors; ++c)
+		{
+			if (_assigned[c])
+				continue;
+			while (!_free[d] || _taken[d])
+				++d;
+			perm.color[c] = (int8_t)d;
+			_taken[d] = true;
+		}
+	}
+};
+
+/// Value in the color table of a permutation that marks a free color.
+const uint8_t FreeColor = 0xff;
+
+/**
+ * Peg permutation and its partial color permutation compiled into byte
+ * tables. A codeword is permuted by looking up each peg in @c source and
+ * then each color in @c color; with SSSE3, each lookup is a single byte
+ * shuffle of the whole codeword.
+ */
+struct
+#ifdef _MSC_VER
+	__declspec(align(16))
+#else
+	__attribute__ ((aligned (16)))
+#endif
+	PermutationTable
+{
+	/// Index of the byte of the codeword that moves onto each peg, or
+	/// 0x80 for the pegs beyond the rules.
+	uint8_t source[16];
+
+	/// Image of each fixed color, or @c FreeColor if the color is free.
+	uint8_t color[16];
+
+	PermutationTable(const CodewordPermutation &p, ColorMask free_colors,
+		int pegs)
+	{
+		std::memset(source, 0x80, sizeof(source));
+		for (int i = 0; i < pegs; ++i)
+			source[(int)p.peg[i]] = (uint8_t)(MM_MAX_COLORS + i);
+
+		std::memset(color, FreeColor, sizeof(color));
+		for (int c = 0; c < MM_MAX_COLORS; ++c)
+		{
+			if (!free_colors[c])
+				color[c] = (uint8_t)p.color[c];
+		}
+	}
+};
+
+/// Orders permutation tables by their bytes.
+inline bool operator < (const PermutationTable &a, const PermutationTable &b)
+{
+	return std::memcmp(&a, &b, sizeof(PermutationTable)) < 0;
+}
+
+/**
+ * Tests whether a candidate, permuted by @c t, maps to a lexicographically
+ * smaller codeword than itself, comparing from peg @c k on. Each free
+ * color is mapped to the smallest free color not yet taken. The pegs
+ * before @c k must map onto the candidate without involving any free
+ * color.
+ *
+ * Only the first @c known pegs of the candidate are read; if the order is
+ * not decided by them, returns @c false. For a prefix of a codeword, a
+ * return value of @c true means that no codeword with that prefix is
+ * canonical.
+ */
+inline bool maps_to_smaller(
+	const Codeword &candidate, const PermutationTable &t,
+	int k, int known, ColorMask free_to)
+{
+	const uint8_t *w = reinterpret_cast<const uint8_t *>(&candidate);
+	const int end = MM_MAX_COLORS + known;
+
+	// Compare the fixed colors up to the first free color, which is
+	// where the color permutation starts to depend on the candidate.
+	for (; k < known; ++k)
+	{
+		if (t.source[k] >= end)
+			return false;
+		int c = t.color[w[t.source[k]]];
+		if (c == FreeColor)
+			break;
+		if (c != candidate[k])
+			return c < candidate[k];
+	}
+	if (k == known)
+		return false;
+
+	uint8_t color[16];
+	std::memcpy(color, t.color, sizeof(color));
+	for (; k < known; ++k)
+	{
+		if (t.source[k] >= end)
+			return false;
+		int c = w[t.source[k]];
+		if (color[c] == FreeColor)
+		{
+			int cc = free_to.smallest();
+			color[c] = (uint8_t)cc;
+			free_to.reset(cc);
+		}
+		if (color[c] != candidate[k])
+			return color[c] < candidate[k];
+	}
+	return false;
+}
+
+/**
+ * Tests whether the first @c known pegs of a codeword may begin a codeword
+ * that is canonical when every peg permutation and every color permutation
+ * is allowed. Such a codeword lists the colors 0, 1, 2, ... in runs whose
+ * lengths do not increase; for example, 000112 is canonical while 001112
+ * and 000221 are not.
+ */
+inline bool is_unrestricted_canonical(const Codeword &w, int known)
+{
+	int run = 0, previous_run = MM_MAX_PEGS;
+	for (int k = 0; k < known; ++k)
+	{
+		if (k > 0 && w[k] == w[k-1])
+		{
+			++run;
+		}
+		else
+		{
+			if (w[k] != (k > 0 ? w[k-1] + 1 : 0))
+				return false;
+			if (k > 0)
+				previous_run = run;
+			run = 1;
+		}
+		if (run > previous_run)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Enumerates the peg permutations that map a codeword onto itself together
+ * with a color permutation, i.e. the peg permutations that map the pegs of
+ * each color onto the pegs of a color that occurs as many times. The
+ * permutations are built peg by peg and found in lexicographic order; a
+ * peg is only tried as an image if it keeps the color permutation
+ * consistent, so the search visits few more nodes than there are
+ * permutations found.
+ */
+class StabilizerSearch
+{
+	int _pegs;
+	Codeword _guess;
+	int _count[MM_MAX_COLORS];
+	bool _assigned[MM_MAX_COLORS];    // whether a color has an image
+	bool _taken_color[MM_MAX_COLORS]; // whether a color is an image
+	bool _taken_peg[MM_MAX_PEGS];     // whether a peg is an image
+	CodewordPermutation _p;
+
+public:
+
+	std::vector<CodewordPermutation> found;
+
+	StabilizerSearch(int pegs, const Codeword &guess)
+		: _pegs(pegs), _guess(guess)
+	{
+		for (int c = 0; c < MM_MAX_COLORS; ++c)
+		{
+			_count[c] = guess.count(c);
+			_assigned[c] = _taken_color[c] = false;
+		}
+		for (int k = 0; k < MM_MAX_PEGS; ++k)
+			_taken_peg[k] = false;
+	}
+
+	/// Assigns an image to the i-th and subsequent pegs.
+	void search(int i)
+	{
+		if (i == _pegs)
+		{
+			found.push_back(_p);
+			return;
+		}
+
+		const int c = _guess[i];
+		for (int k = 0; k < _pegs; ++k)
+		{
+			const int d = _guess[k];
+			if (_taken_peg[k])
+				continue;
+			if (_assigned[c] ? (_p.color[c] != d) :
+				(_taken_color[d] || _count[d] != _count[c]))
+				continue;
+
+			const bool fresh = !_assigned[c];
+			_p.peg[i] = (int8_t)k;
+			_p.color[c] = (int8_t)d;
+			_taken_peg[k] = true;
+			_assigned[c] = _taken_color[d] = true;
+			search(i + 1);
+			_taken_peg[k] = false;
+			if (fresh)
+				_assigned[c] = _taken_color[d] = false;
+		}
+	}
+};
+
+} // namespace
+
 /// Represents an incremental constraint equivalence filter.
 class ConstraintEquivalenceFilter : public EquivalenceFilter
 {
 	const Engine *e;
 	ColorMask free_colors;
 
-	std::vector<	CodewordPermutation> pp;
+	// Peg permutations with their partial color permutations, and the
+	// same permutations compiled against free_colors. A set is shared by
+	// the clones of a filter and never modified; a constraint that
+	// changes it creates a new set.
+	//
+	// Before the first constraint, every peg permutation is allowed with
+	// every color free, and perms is null: the canonical codewords are
+	// then known in closed form, and the first constraint enumerates only
+	// the permutations that fix its guess instead of testing each of the
+	// pegs! permutations.
+	struct PermutationSet
+	{
+		std::vector<CodewordPermutation> pp;
+		std::vector<PermutationTable,
+			util::aligned_allocator<PermutationTable,16>> tables;
+	};
+	std::shared_ptr<const PermutationSet> perms;
+
+	// Compiles the permutations of a set against free_colors.
+	void compile_tables(PermutationSet &set) const;
 
 public:
 
@@ -33,25 +365,40 @@ public:
 	virtual CodewordList get_canonical_guesses(
 		CodewordConstRange candidates) const;
 
+	virtual CodewordList generate_canonical_guesses(const Engine *engine) const;
+
 	virtual void add_constraint(
 		const Codeword &guess,
 		Feedback response,
 		CodewordConstRange remaining
 		);
+
+	virtual bool signature(std::string &sig) const;
+
+	virtual bool find_symmetry(
+		CodewordConstRange from,
+		CodewordConstRange to,
+		CodewordPermutation &perm) const;
 };
 
 /// Initializes a constraint equivalence filter.
 ConstraintEquivalenceFilter::ConstraintEquivalenceFilter(const Engine *engine)
 	: e(engine), free_colors(ColorMask::fill(e->rules().colors()))
 {
-	// Generate all peg permutations, and associate with each peg
-	// permutation a fully unrestricted partial color permutation.
-	CodewordPermutation p;
-	do
+	// Every peg permutation is allowed, with a fully unrestricted
+	// partial color permutation; the permutations are not listed until
+	// the first constraint.
+}
+
+void ConstraintEquivalenceFilter::compile_tables(PermutationSet &set) const
+{
+	set.tables.clear();
+	set.tables.reserve(set.pp.size());
+	for (size_t j = 0; j < set.pp.size(); ++j)
 	{
-		pp.push_back(p);
+		set.tables.push_back(
+			PermutationTable(set.pp[j], free_colors, e->rules().pegs()));
 	}
-	while (std::next_permutation(p.peg + 0, p.peg + e->rules().pegs()));
 }
 
 // Returns a list of canonical guesses given the current constraints.
@@ -59,6 +406,23 @@ CodewordList ConstraintEquivalenceFilter::get_canonical_guesses(
 	CodewordConstRange candidates) const
 {
 	// const bool verbose = false;
+	if (!perms)
+	{
+		const int pegs = e->rules().pegs();
+		CodewordList canonical;
+		for (CodewordConstIterator it = candidates.begin(); it != candidates.end(); ++it)
+		{
+			if (is_unrestricted_canonical(*it, pegs))
+				canonical.push_back(*it);
+		}
+		UPDATE_CALL_COUNTER("ConstraintEquivalence_Input", candidates.size());
+		UPDATE_CALL_COUNTER("ConstraintEquivalence_Output", canonical.size());
+		UPDATE_CALL_COUNTER("ConstraintEquivalence_Reduction", candidates.size() - canonical.size());
+		return canonical;
+	}
+
+	const std::vector<CodewordPermutation> &pp = perms->pp;
+	const auto &tables = perms->tables;
 
 #if 1
 	// Optimization: if there is only one peg permutation left (in
@@ -69,6 +433,14 @@ CodewordList ConstraintEquivalenceFilter::get_canonical_guesses(
 		return CodewordList(candidates.begin(), candidates.end());
 #endif
 
+	const int pegs = e->rules().pegs();
+#if __SSSE3__
+	typedef util::simd::simd_t<uint8_t,16> simd_t;
+	typedef util::simd::xmm_i8 xmm_i8;
+	const int peg_mask = (1 << pegs) - 1;
+	const simd_t free(FreeColor);
+#endif
+
 	// Check each candidate in turn.
 	size_t n = candidates.size();
 	CodewordList canonical;
@@ -78,60 +450,48 @@ CodewordList ConstraintEquivalenceFilter::get_canonical_guesses(
 		const Codeword candidate = candidates.begin()[i];
 		bool is_canonical = true;
 
+#if __SSSE3__
+		const simd_t w = *reinterpret_cast<const simd_t *>(&candidate);
+		const simd_t digits = util::simd::shift_elements_right<MM_MAX_COLORS>(w);
+#endif
+
 		// Check each peg permutation to see if there exists a peg/color
 		// permutation that maps the candidate to a lexicographically
-		// smaller equivalent codeword.
-		for (size_t j = 0; j < pp.size(); ++j)
+		// smaller equivalent codeword. Take, for example, 1223. It must
+		// be able to map to 1123 and show that it's not canonical.
+		for (size_t j = 0; j < tables.size(); ++j)
 		{
-			// Permute the pegs and colors of the candidate.
-			// Free colors are kept unchanged.
-			// Optimization: if this is the identity permutation,
-			// then needn't permute.
-			CodewordPermutation p = pp[j];
-			Codeword permuted_candidate =
-				(j == 0)? candidate : p.permute_pegs(candidate);
-
-			// Check the color on each peg in turn.
-			// Take, for example, 1223. It must be able to map to 1123 and
-			// show that it's not canonical.
-			ColorMask free_from = free_colors, free_to = free_colors;
-			for (int k = 0; k < e->rules().pegs(); ++k)
+			const PermutationTable &t = tables[j];
+#if __SSSE3__
+			// Permute the pegs and map the fixed colors with a shuffle
+			// each, and find the first peg that does not map onto the
+			// candidate. Only from that peg on must the free colors be
+			// assigned one by one.
+			const simd_t p = util::simd::shuffle(w,
+				*reinterpret_cast<const simd_t *>(t.source));
+			const simd_t mapped = util::simd::shuffle(
+				*reinterpret_cast<const simd_t *>(t.color), p);
+			int diff = ~util::simd::byte_mask(mapped == digits) & peg_mask;
+			if (diff == 0)
+				continue;
+			int k = util::intrinsic::bit_scan_forward((unsigned int)diff);
+			if ((util::simd::byte_mask(mapped == free) >> k & 1) == 0)
 			{
-				// Let c be the color on peg k of the peg-permuted candidate.
-				int c = permuted_candidate[k];
-
-				// If c is free, map it to the smallest available free color,
-				// and update the permutation. Otherwise, map it according
-				// to the current permutation.
-				if (free_from[c])
-				{
-					// Find the smallest available free color.
-					int cc = free_to.smallest();
-
-					// Map c to cc.
-					p.color[c] = (char)cc;
-
-					// Clear the respective free-color indicator.
-					free_from.reset(c);
-					free_to.reset(cc);
-				}
-				c = p.color[c];
-
-				// The mapped color, c, must be lexicographically greater
-				// than or equal to the corresponding color in the candidate
-				// for the candidate to be canonical.
-				if (c < candidate[k])
+				if (util::simd::byte_mask(xmm_i8(digits) > xmm_i8(mapped)) >> k & 1)
 				{
 					is_canonical = false;
 					break;
 				}
-				else if (c > candidate[k])
-				{
-					break;
-				}
+				continue;
 			}
-			if (!is_canonical)
+#else
+			int k = 0;
+#endif
+			if (maps_to_smaller(candidate, t, k, pegs, free_colors))
+			{
+				is_canonical = false;
 				break;
+			}
 		}
 
 		// Append the candidate to the result if it's canonical.
@@ -149,6 +509,37 @@ CodewordList ConstraintEquivalenceFilter::get_canonical_guesses(
 	return canonical;
 }
 
+// Generates the canonical guesses peg by peg, extending only the prefixes
+// that no permutation is known to map to a smaller codeword.
+CodewordList ConstraintEquivalenceFilter::generate_canonical_guesses(
+	const Engine * /* engine */) const
+{
+	CodewordList canonical;
+	if (!perms)
+	{
+		generate_codewords(e->rules(), is_unrestricted_canonical, canonical);
+		UPDATE_CALL_COUNTER("ConstraintEquivalence_Generated", canonical.size());
+		return canonical;
+	}
+
+	const auto &tables = perms->tables;
+	if (tables.size() == 1 && free_colors.empty())
+		return CodewordList(e->universe().begin(), e->universe().end());
+
+	generate_codewords(e->rules(), [this, &tables](const Codeword &prefix, int k) -> bool
+	{
+		for (size_t j = 0; j < tables.size(); ++j)
+		{
+			if (maps_to_smaller(prefix, tables[j], 0, k, free_colors))
+				return false;
+		}
+		return true;
+	}, canonical);
+
+	UPDATE_CALL_COUNTER("ConstraintEquivalence_Generated", canonical.size());
+	return canonical;
+}
+
 void ConstraintEquivalenceFilter::add_constraint(
 	const Codeword &guess,
 	Feedback /* response */,
@@ -159,24 +550,47 @@ void ConstraintEquivalenceFilter::add_constraint(
 	if (verbose)
 		std::cout << "Adding constraint: " << guess << std::endl;
 
+	// If no constraint has been added yet, every color is free and the
+	// permutations that remain are exactly those that fix the guess.
+	if (!perms)
+	{
+		StabilizerSearch search(e->rules().pegs(), guess);
+		search.search(0);
+
+		std::shared_ptr<PermutationSet> set(new PermutationSet);
+		set->pp.swap(search.found);
+		for (int i = 0; i < e->rules().pegs(); ++i)
+			free_colors.reset(guess[i]);
+		if (free_colors.unique())
+			free_colors.reset();
+		compile_tables(*set);
+		perms = set;
+		return;
+	}
+
 	// For each peg permutation, restrict its associated partial
 	// color permutation so that the supplied guess maps to itself
 	// under the peg+color permutation. If this is not possible,
-	// remove the peg permutation from the list.
-	for (size_t i = pp.size(); i > 0; )
+	// remove the peg permutation from the list. The permutations are
+	// copied into a new set when the first one changes.
+	const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&guess);
+	std::shared_ptr<PermutationSet> set;
+	for (size_t i = perms->pp.size(); i > 0; )
 	{
 		--i;
-		CodewordPermutation &p = pp[i];
+		CodewordPermutation p = set? set->pp[i] : perms->pp[i];
 
-		// Permute the pegs in the guess.
-		Codeword permuted = p.permute_pegs(guess);
+		// The peg permutation of an unvisited element is unchanged, so
+		// its compiled table gives the source of each permuted peg.
+		const uint8_t *source = perms->tables[i].source;
 
 		// Try to map the color on each peg onto itself.
 		ColorMask free_from = free_colors, free_to = free_colors;
-		bool ok = true;
+		bool ok = true, restricted = false;
 		for (int j = 0; j < e->rules().pegs() && ok; ++j)
 		{
-			if (free_from[permuted[j]])
+			int c = bytes[source[j]];
+			if (free_from[c])
 			{
 				if (!free_to[guess[j]])
 				{
@@ -184,15 +598,25 @@ void ConstraintEquivalenceFilter::add_constraint(
 				}
 				else
 				{
-					p.color[permuted[j]] = (int8_t)guess[j];
-					free_from.reset(permuted[j]);
+					p.color[c] = (int8_t)guess[j];
+					free_from.reset(c);
 					free_to.reset(guess[j]);
+					restricted = true;
 				}
 			}
-			else if (p.color[permuted[j]] != guess[j])
+			else if (p.color[c] != guess[j])
 				ok = false;
 		}
 
+		if (!set)
+		{
+			if (ok && !restricted)
+				continue;
+			set.reset(new PermutationSet);
+			set->pp = perms->pp;
+		}
+		std::vector<CodewordPermutation> &pp = set->pp;
+
 		// Remove the peg permutation if no color permutation exists
 		// that maps the guess onto itself.
 		if (!ok)
@@ -205,6 +629,7 @@ void ConstraintEquivalenceFilter::add_constraint(
 		}
 		else
 		{
+			pp[i] = p;
 			if (verbose)
 				std::cout << "Restricted peg permutation: "
 					<< pp[i] << std::endl;
@@ -212,6 +637,7 @@ void ConstraintEquivalenceFilter::add_constraint(
 	}
 
 	// Restrict the color mask.
+	const ColorMask old_free_colors = free_colors;
 	for (int i = 0; i < e->rules().pegs(); ++i)
 	{
 		free_colors.reset(guess[i]);
@@ -222,10 +648,107 @@ void ConstraintEquivalenceFilter::add_constraint(
 	if (free_colors.unique())
 		free_colors.reset();
 
+	// The tables also depend on the free colors.
+	if (set || free_colors.value() != old_free_colors.value())
+	{
+		if (!set)
+		{
+			set.reset(new PermutationSet);
+			set->pp = perms->pp;
+		}
+		compile_tables(*set);
+		perms = set;
+	}
+
 	// After a few constraints, only the identity permutation
 	// will remain.
 }
 
+// The canonical guesses depend on the set of permutations compiled against
+// the free colors, but not on their order, so the tables are sorted to let
+// states reached through different constraints share a signature.
+bool ConstraintEquivalenceFilter::signature(std::string &sig) const
+{
+	if (!perms)
+	{
+		sig += 'U';
+		return true;
+	}
+
+	std::vector<PermutationTable,
+		util::aligned_allocator<PermutationTable,16>> sorted(perms->tables);
+	std::sort(sorted.begin(), sorted.end());
+
+	ColorMask::value_type free = free_colors.value();
+	uint32_t count = (uint32_t)sorted.size();
+	sig += 'P';
+	sig.append(reinterpret_cast<const char *>(&free), sizeof(free));
+	sig.append(reinterpret_cast<const char *>(&count), sizeof(count));
+	sig.append(reinterpret_cast<const char *>(sorted.data()),
+		sorted.size() * sizeof(PermutationTable));
+	return true;
+}
+
+// Finds a permutation that fixes the guesses and maps one set onto another.
+// The permutations that fix the guesses are those in pp, with the free
+// colors permuted arbitrarily among themselves.
+bool ConstraintEquivalenceFilter::find_symmetry(
+	CodewordConstRange from,
+	CodewordConstRange to,
+	CodewordPermutation &perm) const
+{
+	if (from.size() != to.size())
+		return false;
+
+	std::vector<Codeword::compact_type> target(to.size());
+	for (size_t i = 0; i < to.size(); ++i)
+		target[i] = to[i].pack();
+	std::sort(target.begin(), target.end());
+
+	const int pegs = e->rules().pegs(), colors = e->rules().colors();
+	auto try_permutation = [&](const CodewordPermutation &p) -> bool
+	{
+		SymmetrySearch search(pegs, colors, from, target, p, free_colors);
+		if (!search.search(0))
+			return false;
+		search.complete(colors);
+		perm = search.perm;
+		UPDATE_CALL_COUNTER("ConstraintEquivalence_Symmetry", 1);
+		return true;
+	};
+
+	if (!perms)
+	{
+		// Every peg permutation is allowed; try them in order. As in the
+		// tablebase, the pegs are permuted in a bounded int array; calling
+		// next_permutation on the int8_t pegs directly lets the vectorized
+		// reverse write past the array (-Wstringop-overflow).
+		const int n = std::min(pegs, MM_MAX_PEGS);
+		int sigma[MM_MAX_PEGS];
+		std::iota(sigma + 0, sigma + n, 0);
+		CodewordPermutation p;
+		do
+		{
+			for (int i = 0; i < n; ++i)
+				p.peg[i] = (int8_t)sigma[i];
+			if (try_permutation(p))
+				return true;
+		}
+		while (std::next_permutation(sigma + 0, sigma + n));
+	}
+	else
+	{
+		const std::vector<CodewordPermutation> &pp = perms->pp;
+		for (size_t j = 0; j < pp.size(); ++j)
+		{
+			if (try_permutation(pp[j]))
+				return true;
+		}
+	}
+	UPDATE_CALL_COUNTER("ConstraintEquivalence_Symmetry", 0);
+	return false;
+}
+
 EquivalenceFilter* CreateConstraintEquivalenceFilter(const Engine *e)
 {
 	return new ConstraintEquivalenceFilter(e);
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+#include "Engine.hpp"
+#include "Equivalence.hpp"
+#include "OptimalStrategy.hpp"
+
+namespace Mastermind {
+namespace Heuristics {
+
+// c.f. http://www.javaworld.com.tw/jute/post/view?bid=35&id=138372&sty=1&tpg=1&ppg=1&age=0#138372
+
+/**
+ * Returns an upper bound of the number of secrets in a set that can be
+ * revealed within @c nsteps guesses, where @c f holds the bounds for
+ * fewer guesses.
+ */
+static int max_breakable_within(
+	const Engine *e,
+	CodewordConstRange secrets,       // remaining secrets
+	const EquivalenceFilter *filter,  // equivalence filter of this state
+	const std::vector<int> &f,        // bounds for fewer guesses
+	int nsteps,                       // number of guesses allowed
+	int expand_levels)                // number of levels to expand
+{
+	assert(nsteps >= 0);
+	assert(expand_levels >= 0);
+
+	int n = (int)secrets.size();
+	if (nsteps == 0 || n == 0)
+		return 0;
+	if (nsteps == 1)
+		return 1;
+	if (expand_levels == 0)
+		return std::min(n, f[nsteps]);
+
+	const Feedback perfect = Feedback::perfectValue(e->rules());
+	CodewordList candidates = filter->generate_canonical_guesses(e);
+	int best = 0;
+	for (size_t i = 0; i < candidates.size() && best < n; ++i)
+	{
+		const Codeword &guess = candidates[i];
+		CodewordList partitioned(secrets.begin(), secrets.end());
+		CodewordPartition cells = e->partition(partitioned, guess);
+
+		int count = 0;
+		for (size_t j = 0; j < cells.size(); ++j)
+		{
+			const CodewordRange &cell = cells[j];
+			if (cell.empty())
+				continue;
+			if (Feedback((int)j) == perfect)
+			{
+				++count;
+			}
+			else if (expand_levels == 1)
+			{
+				count += std::min((int)cell.size(), f[nsteps-1]);
+			}
+			else
+			{
+				std::unique_ptr<EquivalenceFilter> child(filter->clone());
+				child->add_constraint(guess, Feedback((int)j), cell);
+				count += max_breakable_within(e, cell, child.get(), f,
+					nsteps - 1, expand_levels - 1);
+			}
+		}
+		best = std::max(best, count);
+	}
+	return std::min(best, n);
+}
+
+std::vector<int> max_breakable_within(
+	const Engine *e,
+	const EquivalenceFilter *filter,
+	int expand_levels)
+{
+	assert(expand_levels >= 1);
+
+	CodewordList all = e->generateCodewords();
+	const int total = (int)all.size();
+	const Feedback perfect = Feedback::perfectValue(e->rules());
+
+	// Partition the secrets by each canonical initial guess. Each
+	// non-perfect cell is a job whose bound is computed in parallel.
+	struct Job
+	{
+		size_t guess;   // index of the initial guess
+		Feedback response;
+		CodewordList cell;
+		std::shared_ptr<EquivalenceFilter> filter;
+		int count;
+	};
+	CodewordList guesses = filter->generate_canonical_guesses(e);
+	std::vector<Job> jobs;
+	for (size_t i = 0; i < guesses.size(); ++i)
+	{
+		CodewordList partitioned(all);
+		CodewordPartition cells = e->partition(partitioned, guesses[i]);
+		for (size_t j = 0; j < cells.size(); ++j)
+		{
+			if (cells[j].empty() || Feedback((int)j) == perfect)
+				continue;
+			Job job;
+			job.guess = i;
+			job.response = Feedback((int)j);
+			job.cell.assign(cells[j].begin(), cells[j].end());
+			job.filter.reset(filter->clone());
+			job.filter->add_constraint(guesses[i], job.response, job.cell);
+			job.count = 0;
+			jobs.push_back(job);
+		}
+	}
+
+	std::vector<int> f;
+	f.push_back(0);
+	f.push_back(1);
+	for (int nsteps = 2; f.back() < total; ++nsteps)
+	{
+		// Each initial guess reveals itself in one step.
+		std::vector<int> counts(guesses.size(), 1);
+
+		int njobs = (int)jobs.size();
+#if _OPENMP
+		#pragma omp parallel for schedule(dynamic)
+#endif
+		for (int k = 0; k < njobs; ++k)
+		{
+			Job &job = jobs[k];
+			job.count = (expand_levels == 1) ?
+				std::min((int)job.cell.size(), f[nsteps-1]) :
+				max_breakable_within(e, job.cell, job.filter.get(), f,
+					nsteps - 1, expand_levels - 1);
+		}
+
+		for (size_t k = 0; k < jobs.size(); ++k)
+			counts[jobs[k].guess] += jobs[k].count;
+		int best = *std::max_element(counts.begin(), counts.end());
+		f.push_back(std::min(std::max(best, f.back()), total));
+	}
+	return f;
+}
+
+} // namespace Mastermind::Heuristics
+} // namespace Mastermind
@@ -25,6 +25,12 @@ public:
 		CodewordConstRange /* remaining */)
 	{
 	}
+
+	virtual bool signature(std::string &sig) const
+	{
+		sig += 'D';
+		return true;
+	}
 };
 
 EquivalenceFilter* CreateDummyEquivalenceFilter(const Engine *)
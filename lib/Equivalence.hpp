@@ -2,7 +2,9 @@
 #define MASTERMIND_EQUIVALENCE_HPP
 
 #include <memory>
+#include <string>
 #include "Engine.hpp"
+#include "Permutation.hpp"
 
 namespace Mastermind {
 
@@ -23,12 +25,90 @@ struct EquivalenceFilter
 		CodewordConstRange candidates
 		) const = 0;
 
+	/// Returns the canonical guesses among all codewords of @c e, which
+	/// must be the engine the filter was created with. The result is the
+	/// same as <code>get_canonical_guesses(e->universe())</code>, but a
+	/// filter may generate the canonical guesses directly instead of
+	/// testing every codeword.
+	virtual CodewordList generate_canonical_guesses(const Engine *e) const
+	{
+		return get_canonical_guesses(e->universe());
+	}
+
 	/// Adds a constraint to the current state.
 	virtual void add_constraint(
 		const Codeword &guess,
 		Feedback response, 
 		CodewordConstRange remaining
 		) = 0;
+
+	/// Appends a signature of the current state to @c sig. Two filters
+	/// with equal signatures return the same canonical guesses from any
+	/// set of candidates. A signature is never the prefix of another, so
+	/// that the signatures of several filters can be concatenated.
+	/// Returns @c false if the filter does not support signatures, in
+	/// which case its canonical guesses must not be cached.
+	virtual bool signature(std::string & /* sig */) const
+	{
+		return false;
+	}
+
+	/// Finds a peg/color permutation that maps every guess added so far
+	/// onto itself, and maps the set of codewords @c from onto the set
+	/// @c to. Returns @c true and stores the permutation in @c perm if
+	/// one is found. Filters that do not keep track of such permutations
+	/// always return @c false.
+	virtual bool find_symmetry(
+		CodewordConstRange /* from */,
+		CodewordConstRange /* to */,
+		CodewordPermutation & /* perm */) const
+	{
+		return false;
+	}
+
+protected:
+
+	/// Appends to @c output, in lexicographic order, the codewords that
+	/// conform to @c rules and whose every prefix is accepted by
+	/// @c accept. The predicate is called as <code>accept(prefix, k)</code>
+	/// after the color on peg <code>k-1</code> is set, and returns
+	/// @c false if no codeword with the first @c k pegs of @c prefix is
+	/// canonical.
+	template <class Predicate>
+	static void generate_codewords(
+		const Rules &rules, Predicate accept, CodewordList &output)
+	{
+		generate_recursion(rules, accept, 0, Codeword(), output);
+	}
+
+private:
+
+	template <class Predicate>
+	static void generate_recursion(
+		const Rules &rules, Predicate &accept, int peg,
+		const Codeword &prefix, CodewordList &output)
+	{
+		// Rules never have more than MM_MAX_PEGS pegs; testing the peg
+		// against the constant lets the compiler see that the recursion
+		// stays within a codeword.
+		assert(rules.pegs() <= MM_MAX_PEGS);
+		if (peg >= MM_MAX_PEGS)
+			return;
+		Codeword w(prefix);
+		int max_repeat = rules.repeatable()? rules.pegs() : 1;
+		for (int c = 0; c < rules.colors(); ++c)
+		{
+			if (w.count(c) >= max_repeat)
+				continue;
+			w.set(peg, c);
+			if (!accept(w, peg + 1))
+				continue;
+			if (peg == rules.pegs() - 1)
+				output.push_back(w);
+			else
+				generate_recursion(rules, accept, peg + 1, w, output);
+		}
+	}
 };
 
 /// Typedef of pointer to function that creates an equivalence filter.
@@ -38,6 +118,7 @@ struct EquivalenceFilter
 extern EquivalenceFilter* CreateDummyEquivalenceFilter(const Engine *e);
 extern EquivalenceFilter* CreateColorEquivalenceFilter(const Engine *e);
 extern EquivalenceFilter* CreateConstraintEquivalenceFilter(const Engine *e);
+extern EquivalenceFilter* CreateAutomorphismEquivalenceFilter(const Engine *e);
 
 /// Composite equivalence filter which chains two underlying filters.
 /// @ingroup equiv
@@ -81,6 +162,12 @@ public:
 		return _filter2->get_canonical_guesses(temp);
 	}
 
+	virtual CodewordList generate_canonical_guesses(const Engine *e) const
+	{
+		CodewordList temp = _filter1->generate_canonical_guesses(e);
+		return _filter2->get_canonical_guesses(temp);
+	}
+
 	virtual void add_constraint(
 		const Codeword & guess,
 		Feedback response, 
@@ -90,6 +177,21 @@ public:
 		_filter2->add_constraint(guess, response, remaining);
 	}
 
+	virtual bool signature(std::string &sig) const
+	{
+		sig += 'M';
+		return _filter1->signature(sig) && _filter2->signature(sig);
+	}
+
+	virtual bool find_symmetry(
+		CodewordConstRange from,
+		CodewordConstRange to,
+		CodewordPermutation &perm) const
+	{
+		return _filter1->find_symmetry(from, to, perm) ||
+			_filter2->find_symmetry(from, to, perm);
+	}
+
 	/// Returns the first filter.
 	const EquivalenceFilter* first() const { return _filter1.get(); }
 
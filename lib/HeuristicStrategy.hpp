@@ -1,6 +1,8 @@
 #ifndef MASTERMIND_HEURISTIC_STRATEGY_HPP
 #define MASTERMIND_HEURISTIC_STRATEGY_HPP
 
+#include <algorithm>
+#include <vector>
 #include "Strategy.hpp"
 #include "util/call_counter.hpp"
 
@@ -55,11 +57,18 @@ template <class Heuristic>
 /// Note that when computing the heuristic score, we always assume that
 /// each codeword in the possibility set is equally-likely to be the
 /// secret.
+///
+/// For large possibility sets, the strategy may optionally run in an
+/// approximate mode (see <code>set_sampling()</code>). In this mode, the
+/// candidates are first scored against a sample of the possibilities,
+/// and only the leading candidates are scored exactly on the full set.
 /// </remarks>
 class HeuristicStrategy : public Strategy
 {
 	const Engine *e;
 	Heuristic h;
+	size_t _sample_size; // number of possibilities to sample; 0 = exact
+	size_t _leaders;     // number of leading candidates to score exactly
 
 	struct choice_t
 	{
@@ -108,10 +117,26 @@ public:
     /// <param name="engine">Context.</param>
     /// <param name="heuristic">Heuristic function object.</param>
 	HeuristicStrategy(const Engine *engine, const Heuristic &heuristic = Heuristic())
-		: e(engine), h(heuristic) { }
+		: e(engine), h(heuristic), _sample_size(0), _leaders(0) { }
 
 	Heuristic& heuristic() { return h; }
 
+	/// <summary>
+	/// Enables or disables approximate evaluation for large possibility
+	/// sets.
+	/// </summary>
+	/// <param name="sample_size">Number of possibilities to score the
+	/// candidates against in the first pass. Sampling only takes place
+	/// if there are more than twice as many possibilities. Set to zero
+	/// to always evaluate exactly.</param>
+	/// <param name="leaders">Number of candidates with the best sampled
+	/// score that are evaluated exactly in the second pass.</param>
+	void set_sampling(size_t sample_size, size_t leaders)
+	{
+		_sample_size = sample_size;
+		_leaders = leaders;
+	}
+
 	/// Returns the name of the strategy.
 	virtual std::string name() const
 	{
@@ -152,6 +177,48 @@ public:
 	}
 #endif
 
+private:
+
+	/// Scores each candidate against a sample of the possibilities, and
+	/// returns the leading candidates in their original order.
+	CodewordList select_leaders(
+		CodewordConstRange possibilities,
+		CodewordConstRange candidates) const
+	{
+		// Take a systematic sample, which is stratified over the
+		// (lexicographical) order of the possibilities. This keeps the
+		// result deterministic.
+		size_t n = possibilities.size(), m = _sample_size;
+		CodewordList sample(m);
+		for (size_t k = 0; k < m; ++k)
+			sample[k] = possibilities[k * n / m];
+
+		std::vector<score_type> scores(candidates.size());
+		evaluate(sample, candidates, &scores[0]);
+
+		// Rank the candidates by their sampled score; ties are broken
+		// by the original order just as in the exact evaluation.
+		std::vector<int> order(candidates.size());
+		for (size_t i = 0; i < order.size(); ++i)
+			order[i] = (int)i;
+		std::partial_sort(order.begin(), order.begin() + _leaders, order.end(),
+			[&](int i, int j) -> bool {
+				if (scores[i] < scores[j])
+					return true;
+				if (scores[j] < scores[i])
+					return false;
+				return i < j;
+		});
+		std::sort(order.begin(), order.begin() + _leaders);
+
+		CodewordList leaders(_leaders);
+		for (size_t i = 0; i < _leaders; ++i)
+			leaders[i] = candidates[order[i]];
+		return leaders;
+	}
+
+public:
+
 	/// Makes the guess that produces the lowest heuristic score.
 	virtual Codeword make_guess(
 		CodewordConstRange possibilities,
@@ -163,6 +230,18 @@ public:
 		if (candidates.empty())
 			return Codeword();
 
+		// In approximate mode, only the leading candidates on a sample
+		// of the possibilities are evaluated exactly.
+		CodewordList leaders;
+		if (_sample_size > 0 && _leaders > 0 &&
+			possibilities.size() > 2 * _sample_size &&
+			candidates.size() > _leaders)
+		{
+			UPDATE_CALL_COUNTER("EvaluateHeuristic_Sampled", (unsigned int)candidates.size());
+			leaders = select_leaders(possibilities, candidates);
+			candidates = leaders;
+		}
+
 #if 0
 		static int debug_i = 0;
 		extern int estimate_obvious_lowerbound(
@@ -0,0 +1,132 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#include "JobDirectory.hpp"
+
+namespace Mastermind {
+
+JobDirectory::JobDirectory(const std::string &dir) : _dir(dir)
+{
+	// The token only needs to differ between the processes that serve
+	// the directory at the same time.
+	std::random_device rd;
+	std::ostringstream ss;
+	ss << std::hex << rd() << (unsigned int)
+		std::chrono::high_resolution_clock::now().time_since_epoch().count();
+	_token = ss.str();
+}
+
+std::string JobDirectory::path(const std::string &name, const char *ext) const
+{
+	return _dir + "/" + name + ext;
+}
+
+bool JobDirectory::has_index() const
+{
+	return !!std::ifstream(path("jobs", "").c_str());
+}
+
+bool JobDirectory::read_index(
+	const std::string &header,
+	std::vector<std::string> &names) const
+{
+	std::ifstream is(path("jobs", "").c_str());
+	std::string line;
+	if (!std::getline(is, line) || line != header)
+		return false;
+
+	names.clear();
+	while (std::getline(is, line))
+	{
+		if (!line.empty())
+			names.push_back(line);
+	}
+	return true;
+}
+
+bool JobDirectory::write_index(
+	const std::string &header,
+	const std::vector<std::string> &names)
+{
+	std::string temp = path("jobs", ".tmp");
+	{
+		std::ofstream os(temp.c_str());
+		os << header << std::endl;
+		for (size_t i = 0; i < names.size(); ++i)
+			os << names[i] << std::endl;
+		if (!os)
+			return false;
+	}
+	return std::rename(temp.c_str(), path("jobs", "").c_str()) == 0;
+}
+
+bool JobDirectory::post(const std::string &name, const std::string &description)
+{
+	// Write the description under a temporary name first, so that a
+	// worker cannot claim a job before its description is complete.
+	std::string temp = path(name, ".tmp");
+	{
+		std::ofstream os(temp.c_str());
+		os << description << std::endl;
+		if (!os)
+			return false;
+	}
+	return std::rename(temp.c_str(), path(name, ".job").c_str()) == 0;
+}
+
+bool JobDirectory::claim(const std::string &name, std::string &description)
+{
+	std::string running = path(name, ".run");
+	if (std::rename(path(name, ".job").c_str(), running.c_str()) != 0)
+		return false;
+
+	std::ifstream is(running.c_str());
+	std::ostringstream ss;
+	ss << is.rdbuf();
+	description = ss.str();
+	return true;
+}
+
+bool JobDirectory::complete(const std::string &name)
+{
+	if (std::rename(partial_result(name).c_str(), result(name).c_str()) != 0)
+		return false;
+	std::remove(path(name, ".run").c_str());
+	return true;
+}
+
+bool JobDirectory::is_complete(const std::string &name) const
+{
+	return !!std::ifstream(result(name).c_str());
+}
+
+bool JobDirectory::fail(const std::string &name)
+{
+	std::remove(partial_result(name).c_str());
+	return std::rename(path(name, ".run").c_str(), path(name, ".fail").c_str()) == 0;
+}
+
+bool JobDirectory::is_failed(const std::string &name) const
+{
+	return !!std::ifstream(path(name, ".fail").c_str());
+}
+
+size_t JobDirectory::requeue(const std::vector<std::string> &names)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < names.size(); ++i)
+	{
+		std::string waiting = path(names[i], ".job");
+		if (std::rename(path(names[i], ".run").c_str(), waiting.c_str()) == 0 ||
+			std::rename(path(names[i], ".fail").c_str(), waiting.c_str()) == 0)
+		{
+			++count;
+		}
+	}
+	return count;
+}
+
+} // namespace Mastermind
@@ -0,0 +1,102 @@
+#ifndef MASTERMIND_JOB_DIRECTORY_HPP
+#define MASTERMIND_JOB_DIRECTORY_HPP
+
+#include <string>
+#include <vector>
+
+namespace Mastermind {
+
+/**
+ * Queue of jobs shared by a number of worker processes through a
+ * directory, which may be on a shared filesystem.
+ *
+ * The directory contains an index file named @c jobs, whose first line
+ * identifies the search the jobs belong to and whose remaining lines are
+ * the names of the jobs. Each job goes through the following files:
+ * - <code>name.job</code>: the description of a job waiting to be solved;
+ * - <code>name.run</code>: the job has been claimed by a worker;
+ * - <code>name.token.part</code>: the result of the job being written by
+ *   the worker identified by @c token;
+ * - <code>name.done</code>: the result of the job is complete;
+ * - <code>name.fail</code>: the worker could not solve the job.
+ *
+ * A worker claims a job by renaming its <code>.job</code> file. Since a
+ * rename is atomic, only one worker can claim each job. If a worker dies,
+ * or fails to solve its job, the job can be requeued by renaming the
+ * <code>.run</code> or <code>.fail</code> file back to <code>.job</code>.
+ * A job requeued while its worker is still alive may be solved twice;
+ * since each worker writes its own partial result, and the results are
+ * the same, this wastes time but does no harm.
+ *
+ * @ingroup Optimal
+ */
+class JobDirectory
+{
+	std::string _dir;
+	std::string _token; // identifies the partial results of this process
+
+	// Returns the path of a file in the directory.
+	std::string path(const std::string &name, const char *ext) const;
+
+public:
+
+	/// Creates a queue in an existing directory.
+	explicit JobDirectory(const std::string &dir);
+
+	/// Tests whether the index file exists.
+	bool has_index() const;
+
+	/**
+	 * Reads the names of the jobs from the index file.
+	 *
+	 * @returns @c true if the index exists and was created for the search
+	 *      identified by @c header, @c false otherwise.
+	 */
+	bool read_index(const std::string &header, std::vector<std::string> &names) const;
+
+	/// Writes the index file, after the job files are posted. The index
+	/// is replaced atomically so that workers never see a partial one.
+	bool write_index(const std::string &header, const std::vector<std::string> &names);
+
+	/// Writes the description of a job that is waiting to be solved.
+	bool post(const std::string &name, const std::string &description);
+
+	/// Claims a job and reads its description. Returns @c false if the
+	/// job is not waiting, e.g. if it was claimed by another worker.
+	bool claim(const std::string &name, std::string &description);
+
+	/// Returns the path of the file that the result of a claimed job is
+	/// written to while the job is being solved by this process.
+	std::string partial_result(const std::string &name) const
+	{
+		return path(name + "." + _token, ".part");
+	}
+
+	/// Marks a claimed job as complete, after its partial result has been
+	/// written and closed.
+	bool complete(const std::string &name);
+
+	/// Returns the path of the result of a complete job.
+	std::string result(const std::string &name) const
+	{
+		return path(name, ".done");
+	}
+
+	/// Tests whether a job is complete.
+	bool is_complete(const std::string &name) const;
+
+	/// Marks a claimed job as failed, and removes its partial result.
+	bool fail(const std::string &name);
+
+	/// Tests whether a job has failed.
+	bool is_failed(const std::string &name) const;
+
+	/// Puts the jobs that are claimed or have failed back in the queue,
+	/// e.g. when a search is restarted after its workers died. Returns
+	/// the number of jobs requeued.
+	size_t requeue(const std::vector<std::string> &names);
+};
+
+} // namespace Mastermind
+
+#endif // MASTERMIND_JOB_DIRECTORY_HPP
@@ -6,6 +6,41 @@
 
 namespace Mastermind {
 
+static_assert(Feedback::MaxOutcomes <= 64,
+	"The feedbacks seen must fit in a 64-bit mask.");
+
+int ObviousGuessMatrix::count_pairs(int i, int limit)
+{
+	const int n = (int)_possibilities.size();
+	assert(i >= 0 && i < n);
+
+	// Fill the rows up to this one.
+	for (; _filled <= i; ++_filled)
+	{
+		const Codeword &guess = _possibilities[_filled];
+		for (int j = _filled + 1; j < n; ++j)
+			_feedback[_filled][j] = _e->compare(guess, _possibilities[j]).value();
+	}
+
+	unsigned long long seen = 0, twice = 0;
+	int pairs = 0;
+	for (int j = 0; j < n; ++j)
+	{
+		if (j == i)
+			continue;
+
+		unsigned long long bit = 1ULL << ((j < i)? _feedback[j][i] : _feedback[i][j]);
+		if (seen & bit)
+		{
+			if ((twice & bit) || ++pairs >= limit)
+				return -1;
+			twice |= bit;
+		}
+		seen |= bit;
+	}
+	return pairs;
+}
+
 /**
  * Checks whether two codewords contain exactly the same set of colors.
  */
@@ -187,39 +222,25 @@ Codeword make_obvious_guess(
 	//   guess. If the cost < lower bound, return this guess firmly. If
 	//   cost = lower bound, then this guess is only optimal in terms of
 	//   total number of steps, but not in depth.
+	// A guess only needs to be checked until it has as many cells with
+	// 2 secrets as the best guess so far, since it can't replace it then.
 	Codeword best_guess;
 	int best_extra = -1;
+	ObviousGuessMatrix matrix(e, possibilities);
 	for (int i = 0; i < count; ++i)
 	{
-		Codeword guess = possibilities[i];
-		FeedbackFrequencyTable freq = e->compare(guess, possibilities);
-		unsigned int nonzero = 1;  // 4A0B
-		unsigned int maxfreq = 0;
-		for (size_t j = 0; j < freq.size() - 2; ++j) // skip 3A0B and 4A0B
-		{
-			if (freq[j])
-			{
-				maxfreq = std::max(maxfreq, freq[j]);
-				++nonzero;
-			}
-		}
-
-		if (maxfreq == 1) // all cells are singleton cells
+		// number of cells with 2 secrets
+		int extra = matrix.count_pairs(i, (best_extra < 0)? count : best_extra);
+		if (extra == 0) // all cells are singleton cells
 		{
 			cost = StrategyCost(2*count-1, 2, (unsigned short)(count-1));
 			obj = MinWorst;
-			return guess;
+			return possibilities[i];
 		}
-		if (maxfreq > 2)
-		{
-			continue;
-		}
-
-		int extra = (int)(count - nonzero); // number of cells with 2 secrets
-		if (best_extra < 0 || extra < best_extra)
+		if (extra > 0)
 		{
 			best_extra = extra;
-			best_guess = guess;
+			best_guess = possibilities[i];
 		}
 	}
 
@@ -228,8 +249,13 @@ Codeword make_obvious_guess(
 	if (best_extra < 0)
 		return Codeword();
 
+	// The secrets in the cells with two secrets need three guesses; that
+	// is only allowed if the depth limit permits.
+	if (max_depth < 3)
+		return Codeword();
+
 	// Update the cost.
-	cost = StrategyCost(2*count-1+best_extra, 3, 1);
+	cost = StrategyCost(2*count-1+best_extra, 3, (unsigned short)best_extra);
 
 	// If exactly one cell contains two secrets and all the rest are
 	// singleton, then this guess is guaranteed to be optimal in steps,
@@ -7,6 +7,56 @@
 
 namespace Mastermind {
 
+/**
+ * Feedbacks of a small set of possibilities compared with each other,
+ * which is used to look for an obvious guess among them.
+ *
+ * Since the feedback of two codewords does not depend on which one is
+ * the guess, each row of the matrix is filled with the possibilities
+ * after it only, and the rest of the row is read from the rows above it.
+ * The rows are filled on demand, so that no comparison is made once an
+ * obvious guess is found.
+ *
+ * @ingroup Obvious
+ */
+class ObviousGuessMatrix
+{
+public:
+
+	/// Maximum number of possibilities, which is the number of distinct
+	/// feedbacks of a guess that is not one of them.
+	static const int MaxSize = MM_MAX_PEGS*(MM_MAX_PEGS+3)/2;
+
+private:
+
+	const Engine *_e;
+	CodewordConstRange _possibilities;
+	int _filled; // number of rows filled
+	Feedback::value_type _feedback[MaxSize][MaxSize];
+
+public:
+
+	/// Creates an empty matrix for the given possibilities.
+	ObviousGuessMatrix(const Engine *e, CodewordConstRange possibilities)
+		: _e(e), _possibilities(possibilities), _filled(0)
+	{
+		assert(possibilities.size() <= (size_t)MaxSize);
+	}
+
+	/**
+	 * Counts the cells with two secrets when the possibilities are
+	 * partitioned by the <code>i</code>-th possibility, not counting the
+	 * perfect cell. The feedbacks seen so far are kept in a bitmask, and
+	 * the scan stops as soon as the guess is known not to qualify, which
+	 * is the case for almost every guess.
+	 *
+	 * @returns The number of cells with two secrets, or -1 if a cell
+	 *      contains more than two secrets or if there are at least
+	 *      @c limit cells with two secrets.
+	 */
+	int count_pairs(int i, int limit);
+};
+
 Codeword make_obvious_guess(
 	const Engine *e,
 	CodewordConstRange possibilities,
@@ -125,19 +175,19 @@ public:
 		// set (if any). If a less-obviously optimal guess is found,
 		// store it temporarily.
 		Codeword less_obvious_guess;
+		ObviousGuessMatrix matrix(e, possibilities);
 		for (size_t i = 0; i < count; ++i)
 		{
-			Codeword guess = possibilities[i];
-			FeedbackFrequencyTable freq = e->compare(guess, possibilities);
-			size_t nonzero = freq.nonzero_count();
-			if (nonzero == count)
+			int pairs = matrix.count_pairs((int)i,
+				less_obvious_guess.IsEmpty()? 2 : 1);
+			if (pairs == 0)
 			{
 				*max_depth = 2;
-				return guess;
+				return possibilities[i];
 			}
-			if (nonzero == count - 1 && less_obvious_guess.IsEmpty())
+			if (pairs == 1)
 			{
-				less_obvious_guess = guess;
+				less_obvious_guess = possibilities[i];
 			}
 		}
 
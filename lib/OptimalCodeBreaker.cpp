@@ -1,11 +1,24 @@
 #include <iostream>
 #include <iomanip>
+#include <fstream>
+#include <sstream>
 #include <cassert>
 #include <algorithm>
 #include <vector>
 #include <array>
 #include <functional>
 #include <numeric>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <chrono>
+
+#if _OPENMP
+#include <omp.h>
+#endif
+#if _OPENMP >= 200805
+#include <atomic>
+#endif
 
 #include "Engine.hpp"
 #include "Strategy.hpp"
@@ -14,6 +27,11 @@
 #include "HeuristicStrategy.hpp"
 #include "OptimalStrategy.hpp"
 #include "StrategyTree.hpp"
+#include "TranspositionTable.hpp"
+#include "Tablebase.hpp"
+#include "Checkpoint.hpp"
+#include "JobDirectory.hpp"
+#include "SearchStatistics.hpp"
 #include "util/call_counter.hpp"
 #include "util/hr_timer.hpp"
 #include "util/io_format.hpp"
@@ -85,6 +103,22 @@ static StrategyCost fill_obviously_optimal_strategy(
 	return _cost;
 }
 
+/**
+ * Returns the cost of an obviously optimal strategy for the given remaining
+ * secrets if one exists, or zero otherwise. This is the cost-only version
+ * of <code>fill_obviously_optimal_strategy()</code>.
+ */
+static StrategyCost obviously_optimal_cost(
+	const Engine *e,            // algorithm engine
+	CodewordConstRange secrets, // list of remaining secrets
+	StrategyObjective obj,
+	StrategyConstraints c)
+{
+	StrategyCost cost;
+	Codeword guess = make_obvious_guess(e, secrets, c.max_depth, obj, cost, obj);
+	return guess.IsEmpty()? StrategyCost() : cost;
+}
+
 #define VERBOSE_COUT(text) WRAP_STATEMENTS( \
 	if (verbose) { \
 		std::cout << std::setw(depth*2) << "" << "[" << (depth+1) << "] " \
@@ -93,456 +127,2451 @@ static StrategyCost fill_obviously_optimal_strategy(
 
 typedef HeuristicStrategy<Heuristics::MinimizeLowerBound> LowerBoundEstimator;
 
-/// @todo: Use heuristic code breaker to estimate an upper bound of total guesses
-/// This could be helpful in pruning obvious bad candidates
+typedef Heuristics::MinimizeLowerBound::score_t lowerbound_t;
+
+/// Minimum number of seconds between two progress reports.
+#define PROGRESS_INTERVAL 10.0
 
 /**
- * Searches for an optimal strategy for the given set of remaining secrets.
+ * Reports the progress of an optimal strategy search to the standard error
+ * stream.
  *
- * @param depth Depth of the current state. This is equal to the number of 
- *      guesses already made.
- * @param threshold Branch pruning threshold. If the cost of revealing all
- *      the secrets would reach or exceed this threshold, the function will
- *      fail. This parameter should be set to the currently best cost achieved
- *      by some known strategy.
- * @returns The cost of the optimal strategy if one is found, or zero if 
- *      one is not found either because some secret would require more than
- *      <code>c.max_depth</code> guesses to reveal, or because the cost of
- *      any strategy would reach or exceed the cut-off threshold.
- * @todo Add progress report (0% - 100%)
+ * The progress is measured by the fraction of the initial guesses that
+ * have been explored. A guess being explored counts by the fraction of
+ * the secrets in the cells solved so far. The remaining time is estimated
+ * by assuming that the rest of the search proceeds at the same rate.
  */
-// @todo: We might change the equivalence filter interface to operate on
-// the input inplace? This could save a few memory copies but may change
-// the output.
-// all the secrets, or -1 if such optimal will not be less than _best_.
-static StrategyCost fill_strategy_tree(
-	const Engine *e,
-	CodewordRange secrets,            // remaining secrets; will be partitioned
-	CodewordRange candidates,         // canonical guesses; may be sorted
-	const EquivalenceFilter *filter1, // response-independent equivalence filter
-	const EquivalenceFilter *filter2, // response-dependent equivalence filter
-	LowerBoundEstimator &estimator,   // lower bound estimator
-	const int depth,                  // depth of the current state; root=0
-	StrategyObjective obj,            // objective
-	StrategyConstraints c,            // constraints
-	StrategyCost threshold,           // prunes branch if cost >= threshold
-	StrategyTree &tree,               // tree to store the strategy found
-	StrategyTree::iterator where      // iterator to the current state
-	)
+class ProgressReport
 {
-	UPDATE_CALL_COUNTER("OptimalRecursion", (int)secrets.size());
-
-	bool verbose = false; // (depth < 1);
-
-	VERBOSE_COUT("Checking " << secrets.size() << " remaining secrets");
-
-	// Fail if the secret set is empty or the max-depth is 0.
-	if (secrets.empty() || c.max_depth == 0)
-		return StrategyCost();
-
-	// Initialize common variables.
-	const Feedback perfect = Feedback::perfectValue(e->rules());
-	const unsigned int nsecrets = (int)secrets.size();
+	std::vector<Codeword::compact_type> _guesses;
+	std::vector<double> _done;
+	util::hr_timer _timer;
+	double _last;
 
-	// Short-cut if there is only one secret.
-	if (nsecrets == 1)
+	static std::string format_time(double seconds)
 	{
-		tree.insert_child(where, StrategyNode(secrets[0], perfect));
-		return StrategyCost(1, 1, 1);
+		long t = (long)seconds;
+		std::ostringstream os;
+		os << (t / 3600) << ':' << std::setfill('0') << std::setw(2)
+			<< (t / 60 % 60) << ':' << std::setw(2) << (t % 60);
+		return os.str();
 	}
 
-	// From now on, we will need to make at least one guess to reveal any 
-	// secret, and at least two guesses to reveal all secrets. This accounts
-	// for n total steps and 1 extra step. 
-	
-	// Update the constraints and threshold so that they will apply to a 
-	// situation after the initial guess.
-	if (c.max_depth == 1)
-		return StrategyCost();
-	else
-		--c.max_depth;
+	void print(bool final)
+	{
+		size_t n = _guesses.size(), count = 0;
+		double fraction = 0.0;
+		for (size_t i = 0; i < n; ++i)
+		{
+			fraction += _done[i] / n;
+			if (_done[i] >= 1.0)
+				++count;
+		}
+		double elapsed = _timer.stop();
+		std::cerr << "Progress: " << std::fixed << std::setprecision(1)
+			<< (fraction * 100.0) << "% (" << count << " of " << n
+			<< " initial guesses done), elapsed " << format_time(elapsed);
+		if (!final && fraction > 0.0)
+			std::cerr << ", remaining ~" << format_time(elapsed / fraction - elapsed);
+		std::cerr << std::endl;
+		_last = elapsed;
+	}
 
-	if (threshold.steps <= nsecrets)
-		return StrategyCost();
-	else
-		threshold.steps -= nsecrets;
+public:
 
-	// @bug The following criteria is problematic.
-	if (threshold.depth <= 1)
-		return StrategyCost();
-	else
-		--threshold.depth;
+	ProgressReport() : _last(0.0) { _timer.start(); }
 
-	// Define a strategy cost comparer.
-	StrategyCostComparer superior(obj);
+	/// Starts the search with the given initial guesses.
+	void start(CodewordConstRange guesses)
+	{
+		_guesses.clear();
+		for (CodewordConstIterator it = guesses.begin(); it != guesses.end(); ++it)
+			_guesses.push_back(it->pack());
+		_done.assign(_guesses.size(), 0.0);
+	}
 
-#if 0
-	// If find_last is true, then we only cut-off a guess when it's
-	// strictly worse than the current best; otherwise, we cut-off
-	// a guess as long as it's no better than the current best.
-	int cut_off_delta = (c.find_last? 1 : 0);
-	cut_off += cut_off_delta ???
+	/// Updates the fraction of an initial guess explored, and prints the
+	/// progress if it has not been printed for a while.
+	void update(const Codeword &guess, double fraction)
+	{
+		Codeword::compact_type w = guess.pack();
+#if _OPENMP
+		#pragma omp critical (ProgressReport)
 #endif
+		{
+			for (size_t i = 0; i < _guesses.size(); ++i)
+			{
+				if (_guesses[i] == w && _done[i] < fraction)
+					_done[i] = fraction;
+			}
+			if (_timer.stop() - _last >= PROGRESS_INTERVAL)
+				print(false);
+		}
+	}
 
-	// Filter canonical guesses as candidates.
-	//CodewordList candidates = filter->get_canonical_guesses(e.universe());
-	//VERBOSE_COUT("Found " << candidates.size() << " canonical guesses.");
-
-	// Compute a lower bound of the cost for each candidate guess, exluding
-	// the cost of making the initial guess because this is the same for all
-	// candidates. Then sort the candidates by this lower bound so that more
-	// "promising" candidates are processed first. This helps to improve the
-	// upper bound as early as possible.
-	// @todo It might be better to rename scores to extra_cost.
-	typedef Heuristics::MinimizeLowerBound::score_t lowerbound_t;
-	std::vector<lowerbound_t> scores(candidates.size());
-	//estimator.make_guess(secrets, candidates, scores.data());
-	estimator.evaluate(secrets, candidates, scores.data());
-
-	// @todo We might opt to remove the need to create an index array.
-	// Instead, we could scan for the element in each iteration.
-	std::vector<int> order(candidates.size());
-	std::iota(order.begin(), order.end(), 0);
+	/// Marks all initial guesses as explored and prints the final progress.
+	void finish()
+	{
+		_done.assign(_guesses.size(), 1.0);
+		print(true);
+	}
+};
 
-	// Define SORT_CANDIDATES to 1 to explicitly sort the candidate guesses.
-	// Since many guesses will be pruned right away (especially if we have
-	// a good estimate of the lower-bound of the cost), it is usually faster
-	// to (linearly) search for the smallest element in each iteration,
-	// instead of sorting the whole array at the beginning. However, the
-	// results will be the same as long as we perform a stable sort.
-#define SORT_CANDIDATES 0
+/// Maps the hash key of a set of secrets to the cost of revealing them
+/// with a known strategy, which is an upper bound of the optimal cost.
+typedef std::unordered_map<TranspositionTable::key_type, StrategyCost> UpperBoundMap;
 
-#if SORT_CANDIDATES
-	std::sort(order.begin(), order.end(), [&](int i, int j) -> bool {
-		if (superior(scores[i], scores[j]))
-			return true;
-		if (superior(scores[j], scores[i]))
-			return false;
-		return i < j;
-	});
-#endif
+/// State shared by all the recursive calls of an optimal strategy search.
+struct SearchContext
+{
+	const Engine *e;                // algorithm engine
+	LowerBoundEstimator *estimator; // lower bound estimator
+	StrategyObjective obj;          // objective
+	TranspositionTable *tt;         // transposition table; may be NULL
+	Tablebase *tb;                  // endgame tablebase; may be NULL
+	Checkpoint *checkpoint;         // journal of solved subproblems; may be NULL
+	ProgressReport *progress;       // progress report; may be NULL
+	SearchStatistics *stats;        // per-depth statistics; may be NULL
+	bool history;                   // whether to order ties by history
+	bool mtd;                       // whether to solve by narrow searches
+	const UpperBoundMap *upper_bounds; // cost of a known strategy; may be NULL
+};
 
-	// Initialize state variables to store the best guess and its cost so far.
-	StrategyCost best;
-	StrategyTree best_tree(e->rules());
+/**
+ * Collects the cost of a known strategy at each state of its tree.
+ *
+ * The secrets of a state are the ones revealed in its branch. The cost of
+ * revealing them is accumulated from the leaves upward in a single pass
+ * over the nodes. If the same set of secrets occurs in multiple states,
+ * the lowest cost is kept.
+ */
+static void collect_upper_bounds(
+	const StrategyTree &tree,
+	StrategyObjective obj,
+	UpperBoundMap &bounds)
+{
+	const Feedback perfect = Feedback::perfectValue(tree.rules());
 
-	// Try each candidate guess.
-	size_t candidate_count = candidates.size();
-	for (size_t index = 0; index < candidate_count; ++index)
+	// States on the path from the root to the current node.
+	struct State
 	{
-#if !SORT_CANDIDATES
-		// Find the guess with the lowest estimated cost in the remaining
-		// candidates, and swap it to the front.
-		auto min_it = std::min_element(order.begin() + index, order.end(),
-			[&](int i, int j) -> bool { 
-				return superior(scores[i], scores[j]); 
-		});
-		std::swap(*min_it, order[index]);
-#endif
-		size_t i = order[index];
-		Codeword guess = candidates[i];
-
-		// Since we keep improving the upper bound dynamically,
-		// and we sort the candidates by their lower bound,
-		// we need to check here whether the remaining candidates
-		// are still worth checking.
-		if (!superior(scores[i], threshold))
-		{
-			VERBOSE_COUT("Pruned " << (candidate_count - index)
-				<< " remaining guesses: lower bound (" << scores[i]
-				<< ") >= cut-off (" << threshold << ")");
-#if 0
-			if (i == 0)
-			{
-				std::cout << "Very first pruned: best lower bound = "
-					<< scores[i] << ", cut-off = " << cut_off << std::endl;
-			}
-#endif
-			break;
+		int depth;           // depth of the node of the state
+		TranspositionTable::key_type hash; // hash key of the secrets
+		unsigned int count;  // number of secrets
+		StrategyCost cost;   // cost of revealing the secrets
+	};
+	std::vector<State> path;
+
+	// Records the cost of the last state on the path, and adds it to the
+	// cost of its parent state, one guess deeper.
+	auto close = [&]()
+	{
+		State s = path.back();
+		path.pop_back();
+		UpperBoundMap::iterator it = bounds.find(s.hash);
+		if (it == bounds.end())
+			bounds.insert(std::make_pair(s.hash, s.cost));
+		else if (superior(s.cost, it->second, obj))
+			it->second = s.cost;
+
+		if (!path.empty())
+		{
+			State &parent = path.back();
+			parent.hash ^= s.hash;
+			parent.count += s.count;
+			parent.cost += StrategyCost(s.cost.steps + s.count,
+				(unsigned short)(s.cost.depth + 1), s.cost.worst);
 		}
+	};
 
-		VERBOSE_COUT("Checking guess " << (i+1) << " of "
-			<< candidate_count << " (" << guess << ") -> ");
+	auto nodes = tree.traverse(tree.root());
+	for (auto it = nodes.begin(); it != nodes.end(); ++it)
+	{
+		while (!path.empty() && path.back().depth >= it.depth())
+			close();
 
-		// If there's a limit on the maximum number of guesses allowed,
-		// check if we can prune it.
-		if (scores[i].depth > c.max_depth)
+		if (it != nodes.begin() && it->response() == perfect)
 		{
-			if (verbose)
-				std::cout << "Skipped: guess will have too many steps"
-				<< std::endl;
-			continue;
+			State &parent = path.back();
+			parent.hash ^= TranspositionTable::hash(it->guess());
+			parent.count += 1;
+			parent.cost += StrategyCost(1, 1, 1);
 		}
-
-#if 0
-		static size_t test_counter = 0;
-		++test_counter;
-		if (test_counter == 8479)
+		else
 		{
-			__debugbreak();
+			State s;
+			s.depth = it.depth();
+			s.hash = 0;
+			s.count = 0;
+			path.push_back(s);
 		}
+	}
+	while (!path.empty())
+		close();
+}
+
+/**
+ * Define OPTIMAL_PARALLEL to 1 to explore the candidate guesses of the
+ * top levels of the search tree in parallel when running with more than
+ * one thread. This requires OpenMP 3.0 (for tasks).
+ *
+ * Each candidate guess of a node at depth less than PARALLEL_DEPTH is
+ * explored by an OpenMP task, so idle threads pick up work from deeper
+ * levels as well. The best cost found by any task is published through
+ * an atomic so that all tasks prune against it.
+ */
+#if _OPENMP >= 200805
+#define OPTIMAL_PARALLEL 1
+#else
+#define OPTIMAL_PARALLEL 0
 #endif
 
-		// Partition the remaining secrets using this guess.
-		// Note that after successive calls to @c partition,
-		// the order of the secrets are shuffled. However,
-		// that should not impact the optimality of the result.
-		CodewordPartition cells = e->partition(secrets, guess);
-
-		// Sort the partitions by their size, so that smaller partitions
-		// (i.e. smaller search trees) are processed first. This helps
-		// to improve the lower bound (slack) at an earlier stage.
-		std::array<int,Feedback::MaxOutcomes> responses;
-		size_t nresponses = cells.size();
-		std::iota(responses.begin(), responses.begin() + nresponses, 0);
-		std::sort(responses.begin(), responses.begin() + nresponses,
-			[&cells](int i, int j) -> bool
-		{
-			if (cells[i].size() == 0)
-				return false;
-			if (cells[j].size() == 0)
-				return true;
-			if (cells[i].size() < cells[j].size())
-				return true;
-			if (cells[j].size() < cells[i].size())
-				return false;
-			return i < j;
-		});
-
-		// Find the number of availble responses, and skip this guess if it 
-		// generates only one response.
-		while (nresponses > 0 && cells[responses[nresponses-1]].empty())
-			--nresponses;
-		if (nresponses <= 1)
-		{
-			if (verbose)
-				std::cout << "Skipped: guess produces unit partition"
-				<< std::endl;
-			continue;
-		}
+#define PARALLEL_DEPTH 2
 
-		// Estimate a lower bound of the cost of revealing the secrets in 
-		// each partition, NOT counting the cost of making the initial guess.
-		// If the total lower bound reaches or exceeds the cut-off threshold,
-		// we can prune this guess.
-		// Note: this step is redundant because we have already calculated
-		// the same score before.
-		StrategyCost lb_part[256];
-		StrategyCost lb;
-		for (size_t j = 0; j < nresponses; ++j)
-		{
-			Feedback feedback = Feedback(responses[j]);
-			if (feedback != perfect)
-			{
-				lowerbound_t estimate =
-					estimator.heuristic().simple_estimate((int)cells[feedback.value()].size());
-				lb_part[j] = estimate;
-				lb += lb_part[j];
-			}
-		}
+/**
+ * The results of the subproblems at depth up to CHECKPOINT_DEPTH are
+ * journaled when a checkpoint file is specified. A deeper level makes a
+ * resumed search lose less work, but produces a larger file.
+ */
+#define CHECKPOINT_DEPTH 2
 
-		// Since this is a double-computation, we shouldn't be pruning
-		// this guess here.
-		assert(lb == scores[i]);
+/**
+ * Define SYMMETRIC_CELLS to 1 to solve only once the cells of a partition
+ * that are mapped onto each other by a symmetry of the state before the
+ * guess. Such cells have the same optimal cost, and the strategy of one
+ * is obtained by permuting the strategy of the other.
+ */
+#define SYMMETRIC_CELLS 1
 
-		if (verbose)
-		{
-			std::cout << nresponses << " cells:";
-			for (size_t j = 0; j < nresponses; ++j)
-			{
-				if (j > 0)
-					std::cout << ',';
-				std::cout << cells[responses[j]].size();
-			}
-			std::cout << "; lower bound = " 	<< lb 
-				<< ", best = " << best << std::endl;
-		}
-
-		// Find the best guess for each partition. We adopt a two-phase
-		// equivalence filtering method. First, we filter all possible
-		// codewords by (response-indepedent) constraint equivalence.
-		// This can be done once for all response classes. Then, for each
-		// individual response class, we apply the response-dependent 
-		// color equivalence filter.
-		CodewordList pre_filtered;
-		std::unique_ptr<EquivalenceFilter> pre_filter(filter1->clone());
-		pre_filter->add_constraint(guess, Feedback(), e->universe());
-		// @todo we may change the interface of add_constraint to return
-		// a new filter.
-
-		bool pruned = false;
-		StrategyTree this_tree(e->rules());
-		for (size_t j = 0; j < nresponses && !pruned; ++j)
-		{
-			Feedback feedback = Feedback(responses[j]);
-			const CodewordRange &cell = cells[feedback.value()];
+/**
+ * Define ENDGAME_SOLVER to 1 to solve small cells in closed form where
+ * the optimality of the result can be proved, instead of searching them.
+ * This is only done when the objective is MinSteps.
+ */
+#define ENDGAME_SOLVER 1
 
-			// Add this node to the strategy tree.
-			StrategyNode node(guess, feedback);
-			StrategyTree::iterator it = this_tree.insert_child(this_tree.root(), node);
+/// Cells with up to this many times as many secrets as there are distinct
+/// feedbacks are passed to the endgame solver.
+#define ENDGAME_SIZE_FACTOR 1
 
-			// Do not recurse for a perfect match.
-			if (feedback == perfect)
-			{
-				VERBOSE_COUT("- Checking cell " << feedback
-					<< " -> perfect");
-				continue;
-			}
+/// Threshold of a search with no pruning.
+#define UNLIMITED_STEPS 1000000
 
-			VERBOSE_COUT("- Checking cell " << feedback
-				<< " -> lower bound = " << lb_part[j]);
-
-			// Short-cut if only one additional guess is allowed
-			// but we are left with more than one secret in this
-			// partition.
-			// @todo such pruning could be improved and consolidated with
-			//  the pruning in the beginning of the routine.
-			if (c.max_depth == 1 && cell.size() > 1)
-			{
-				pruned = true;
-				break;
-			}
+/// Returns the lowest cost that is strictly inferior to @c cost with
+/// regard to the objective @c obj. Using it as a threshold accepts any
+/// strategy that is no worse than @c cost.
+static StrategyCost successor(StrategyCost cost, StrategyObjective obj)
+{
+	if (obj <= MinSteps)
+		return StrategyCost(cost.steps + 1, 0, 0);
+	else if (obj <= MinDepth)
+		return StrategyCost(cost.steps, cost.depth + 1, 0);
+	else
+		return StrategyCost(cost.steps, cost.depth, cost.worst + 1);
+}
 
-			// If there's an obviously optimal guess for this cell, use it.
-			// @todo "mastermind -v -s optimal -r mm -md 5" doesn't
-			// respect the "-md 5" option.
-			StrategyCost cell_cost = fill_obviously_optimal_strategy(
-				e, cell, obj, c, this_tree, it);
-			if (!!cell_cost)
-			{
-				//VERBOSE_COUT("- Checking cell " << cell.feedback
-				//	<< " -> found obvious guess");
-				VERBOSE_COUT("  Found obvious guess");
-			}
-			else
-			{
-				//VERBOSE_COUT("- Checking cell " << cell.feedback
-				//	<< " -> lower bound = " << lb);
-				//VERBOSE_COUT("- Checking cell " << cell.feedback
-				//	<< " -> lower bound = " << lb_part[j]);
-
-				// @todo: estimate a lower bound of the cost of any guess.
-				// If the lower bound is greater than the cut-off, we don't
-				// need to proceed any more.
-
-				// Apply constraint filter on the candidate guesses if not 
-				// already done so. This filter does not depend on the response,
-				// so a single run can be used for all response classes.
-				if (pre_filtered.empty())
-				{
-					if (c.pos_only)
-						pre_filtered = pre_filter->get_canonical_guesses(secrets);
-					else
-						pre_filtered = pre_filter->get_canonical_guesses(e->universe());
-				}
+/// Returns the total cost of the cells of a partition, excluding the cell
+/// at position @c skip.
+static StrategyCost aggregate_cost(
+	const StrategyCost parts[], size_t n, size_t skip = (size_t)-1)
+{
+	StrategyCost total;
+	for (size_t j = 0; j < n; ++j)
+	{
+		if (j != skip)
+			total += parts[j];
+	}
+	return total;
+}
 
-				// Apply color filter on the pre-filtered candidates.
-				std::unique_ptr<EquivalenceFilter> new_filter(filter2->clone());
-				new_filter->add_constraint(guess, feedback, cell);
-				CodewordList canonical = new_filter->get_canonical_guesses(pre_filtered);
-
-				// @todo: Check this. The minus sign doesn't work for complex
-				// cost structure.
-				cell_cost = fill_strategy_tree(e, cell, canonical,
-					pre_filter.get(), new_filter.get(), estimator,
-					depth + 1, obj, c, threshold - (lb - lb_part[j]),
-					this_tree, it);
-			}
+/**
+ * Returns the threshold for the cost of one cell of a partition, given
+ * that the other cells cost @c rest in total. The total cost is superior
+ * to @c threshold if and only if the cost of the cell is superior to the
+ * returned threshold. The steps can simply be subtracted, but the depth
+ * and worst count cannot: a cell that ties the steps passes only if the
+ * combined depth and worst count still beat the threshold.
+ *
+ * @returns The threshold for the cell, or zero if no cost of the cell can
+ *      meet @c threshold.
+ */
+static StrategyCost cell_threshold(
+	const StrategyCost &threshold,
+	const StrategyCost &rest,
+	StrategyObjective obj)
+{
+	if (threshold.steps <= rest.steps)
+		return StrategyCost();
 
-			if (!cell_cost) // No strategy was found for this cell
-			{
-				VERBOSE_COUT("Pruned this guess because the recursion returns -1.");
-				pruned = true;
-				break;
-			}
+	StrategyCost t(threshold.steps - rest.steps, threshold.depth, threshold.worst);
+	if (obj <= MinSteps || rest.depth < threshold.depth)
+		return t;
 
-#if 1
-			if (superior(lb_part[j], cell_cost))
-				VERBOSE_COUT("  Cell optimal cost is " << cell_cost);
-			else if (superior(cell_cost, lb_part[j]))
-				VERBOSE_COUT("  ERROR: LOWER BOUND IS HIGHER THAN ACTUAL COST.");
-			else
-				VERBOSE_COUT("  Lower bound unchanged.");
-#endif
+	// The other cells already reach the depth of the threshold. Ties in
+	// steps can then only pass on the worst count, and only if the other
+	// cells leave room for it.
+	if (obj >= MinWorst && rest.depth == threshold.depth &&
+		rest.worst < threshold.worst)
+	{
+		t.worst = (unsigned short)(threshold.worst - rest.worst);
+		return t;
+	}
+	return StrategyCost(t.steps, 0, 0);
+}
 
-			// Refine the lower bound estimate.
-			// @bug: the lower bound estimate needs to be amended
-			lb += (cell_cost - lb_part[j]);
-			lb_part[j] = cell_cost;
-			if (!superior(lb, threshold))
-			{
-				VERBOSE_COUT("Skipping " << (nresponses-j-1) << " remaining "
-					<< "partitions because lower bound (" << lb << ") >= best ("
-					<< best << ")");
-				pruned = true;
-				break;
-			}
-		}
+#if OPTIMAL_PARALLEL
+/**
+ * Stores the best cost found so far by the tasks that explore the
+ * candidate guesses of a single node in parallel.
+ *
+ * The cost is packed into an integer whose natural order agrees with the
+ * order of costs under the objective, so that it can be read and improved
+ * atomically without a lock.
+ */
+class SharedBound
+{
+	std::atomic<unsigned long long> _value;
+	StrategyObjective _obj;
 
-		// Now the guess is either pruned, or is the best guess so far.
-		if (!pruned)
-		{
-			assert(superior(lb, threshold));
-			assert(!best || superior(lb, best));
-			best = lb;
-			threshold = best;
-			VERBOSE_COUT("Improved cut-off to " << best);
+	unsigned long long pack(const StrategyCost &cost) const
+	{
+		unsigned long long v = (unsigned long long)cost.steps << 32;
+		if (_obj >= MinDepth)
+			v |= (unsigned long long)cost.depth << 16;
+		if (_obj >= MinWorst)
+			v |= cost.worst;
+		return v;
+	}
 
-			// Use this_tree as best_tree.
-			// @todo: optimize swap()
-			std::swap(this_tree, best_tree);
-		}
+public:
+
+	SharedBound(const StrategyCost &initial, StrategyObjective obj)
+		: _value(0), _obj(obj) { _value = pack(initial); }
+
+	/// Returns the current bound.
+	StrategyCost load() const
+	{
+		unsigned long long v = _value;
+		return StrategyCost((unsigned int)(v >> 32),
+			(unsigned short)(v >> 16), (unsigned short)v);
 	}
 
-	// If a best strategy was found, append the strategy to the tree.
-	// Also, since 'best' is calculated without accounting for the initial
-	// guess, we need to add it back.
-	if (!!best)
+	/// Lowers the bound to @c cost if @c cost is superior.
+	void improve(const StrategyCost &cost)
 	{
-		tree.insert_child(where, best_tree, false);
-		best.steps += nsecrets;
-		++best.depth;
-		// best.worst;
+		unsigned long long v = pack(cost);
+		unsigned long long old = _value;
+		while (v < old && !_value.compare_exchange_weak(old, v));
 	}
+};
+#else
+class SharedBound;
+#endif
 
-	return best;
-}
+/// Number of counters in a history table.
+#define HISTORY_TABLE_SIZE 4096
 
-StrategyTree build_optimal_strategy_tree(
-	const Engine *e, StrategyObjective obj, StrategyConstraints constraints)
+/**
+ * Records how often each guess turned out to be the optimal guess of a
+ * subproblem at each depth (the history heuristic). Candidates with equal
+ * lower bounds are explored in the order of their history, so that a
+ * guess that won in a sibling or cousin subproblem is tried first.
+ *
+ * The table is direct-mapped by guess and depth, and colliding guesses
+ * share a counter; this only affects the order of exploration. To keep
+ * the search deterministic, a table is only shared by subproblems that
+ * are solved sequentially: a new table is created for each guess at depth
+ * <code>PARALLEL_DEPTH - 1</code>, and the nodes above use no history.
+ *
+ * The optimal guess of a subproblem is the same with or without history,
+ * so that the transposition table and the strategy tree do not depend on
+ * the order in which subproblems are solved. This requires the candidates
+ * that would have come first to be checked for ties, which costs extra
+ * searches; the history is therefore only used if requested in
+ * <code>OptimalSearchOptions::history</code>.
+ */
+class HistoryTable
 {
-	CodewordList all = e->generateCodewords();
+	std::vector<unsigned int> _counts;
 
-	// Creates a composite equivalence filter by chaining a
-	// response-indepedent filter with a response-dependent filter.
-	CompositeEquivalenceFilter filter(
-		CreateConstraintEquivalenceFilter(e),
-		CreateColorEquivalenceFilter(e));
+	static size_t index(const Codeword &guess, int depth)
+	{
+		TranspositionTable::key_type h = TranspositionTable::hash(guess);
+		h ^= (TranspositionTable::key_type)depth * 0x9E3779B97F4A7C15ULL;
+		return (size_t)(h >> 32) % HISTORY_TABLE_SIZE;
+	}
 
-	// Create a strategy tree.
-	StrategyTree tree(e->rules());
+public:
 
-	// Set options.
-	// StrategyObjective obj = min_depth ? MinDepth : MinSteps;
-	//StrategyConstraints c;
-	//c.max_depth = (unsigned char)std::min(100, max_depth);
-	//c.find_last = false;
+	HistoryTable() : _counts(HISTORY_TABLE_SIZE) { }
 
-	// Create a cost lower-bound estimator.
-	LowerBoundEstimator estimator(e, Heuristics::MinimizeLowerBound(e));
+	/// Returns the history score of a guess at the given depth.
+	unsigned int score(const Codeword &guess, int depth) const
+	{
+		return _counts[index(guess, depth)];
+	}
+
+	/// Records a guess that is optimal for a subproblem of the given size.
+	/// Larger subproblems weigh more.
+	void record(const Codeword &guess, int depth, unsigned int weight)
+	{
+		_counts[index(guess, depth)] += weight;
+	}
+};
+
+static StrategyCost fill_strategy_tree(
+	const SearchContext &ctx,
+	CodewordRange secrets,
+	TranspositionTable::key_type hash,
+	CodewordRange candidates,
+	const EquivalenceFilter *filter1,
+	const EquivalenceFilter *filter2,
+	const int depth,
+	StrategyConstraints c,
+	StrategyCost threshold,
+	HistoryTable *history,
+	Codeword &best_guess);
+
+/**
+ * Scores each candidate guess by a lower bound of the cost of revealing
+ * the secrets after making this guess, not counting the guess itself.
+ * Each cell is estimated with the branching factor of the whole game.
+ *
+ * Also finds the largest number of non-perfect cells that any candidate
+ * splits the secrets into. The candidates are canonical, so every guess
+ * that can be made from this state or below is equivalent to one of them,
+ * and no guess can split a cell below this state any further. The cells
+ * can therefore be estimated with this branching factor instead, which
+ * gives a much tighter bound for small states; see
+ * <code>tighter_bound()</code>.
+ *
+ * @returns The branching factor of the state.
+ */
+static int score_candidates(
+	const SearchContext &ctx,
+	CodewordConstRange secrets,       // remaining secrets
+	CodewordConstRange candidates,    // canonical guesses
+	lowerbound_t scores[])            // receives the score of each candidate
+{
+	const Engine *e = ctx.e;
+	const Heuristics::MinimizeLowerBound &h = ctx.estimator->heuristic();
+	const Feedback perfect = Feedback::perfectValue(e->rules());
+	const int n = (int)candidates.size();
+
+	std::vector<int> parts(n);
+#if _OPENMP
+	#pragma omp parallel for schedule(static)
+#endif
+	for (int i = 0; i < n; ++i)
+	{
+		FeedbackFrequencyTable freq = e->compare(candidates[i], secrets);
+		scores[i] = h.compute(freq);
+		parts[i] = (int)freq.nonzero_count() - (freq[perfect.value()] ? 1 : 0);
+	}
+
+	int branching = n > 0 ? *std::max_element(parts.begin(), parts.end()) : 0;
+	UPDATE_CALL_COUNTER("OptimalBranchingFactor", branching);
+	return branching;
+}
+
+/**
+ * Tightens the score of a candidate guess by estimating each cell with
+ * the branching factor of the state, as returned by
+ * <code>score_candidates()</code>. The candidates are still explored in
+ * the order of their score, so that the strategy found does not change,
+ * but the tighter bound prunes many of them without partitioning the
+ * secrets. It is only computed for the candidates that the score does
+ * not prune, since most of them are.
+ */
+static lowerbound_t tighter_bound(
+	const SearchContext &ctx,
+	CodewordConstRange secrets,       // remaining secrets
+	const Codeword &guess,            // the candidate guess
+	const lowerbound_t &score,        // score of the candidate
+	const int branching)              // branching factor of the state
+{
+	const Heuristics::MinimizeLowerBound &h = ctx.estimator->heuristic();
+	if (branching >= h.branching_factor())
+		return score;
+	return h.compute(ctx.e->compare(guess, secrets), branching);
+}
+
+/**
+ * Sorts the responses of a partition so that smaller cells (i.e. smaller
+ * search trees) come first, with empty cells at the end.
+ *
+ * @returns The number of non-empty cells.
+ */
+static size_t order_cells(
+	const CodewordPartition &cells,
+	std::array<int,Feedback::MaxOutcomes> &responses)
+{
+	size_t nresponses = cells.size();
+	std::iota(responses.begin(), responses.begin() + nresponses, 0);
+	std::sort(responses.begin(), responses.begin() + nresponses,
+		[&cells](int i, int j) -> bool
+	{
+		if (cells[i].size() == 0)
+			return false;
+		if (cells[j].size() == 0)
+			return true;
+		if (cells[i].size() < cells[j].size())
+			return true;
+		if (cells[j].size() < cells[i].size())
+			return false;
+		return i < j;
+	});
+	while (nresponses > 0 && cells[responses[nresponses-1]].empty())
+		--nresponses;
+	return nresponses;
+}
+
+/**
+ * Hash keys of the cells of a partition, computed when first needed.
+ *
+ * Since the key of a set is the exclusive-or of the keys of its elements,
+ * the key of the largest cell, which <code>order_cells()</code> puts
+ * last, is derived from the key of the partitioned secrets and the keys
+ * of the other cells, unless the other cells not hashed yet hold more
+ * secrets than it does.
+ */
+class CellHashes
+{
+	typedef TranspositionTable::key_type key_type;
+
+	const CodewordPartition &_cells;
+	const std::array<int,Feedback::MaxOutcomes> &_responses;
+	size_t _count;  // number of non-empty cells
+	key_type _hash; // key of the partitioned secrets
+	key_type _keys[Feedback::MaxOutcomes];
+	bool _known[Feedback::MaxOutcomes];
+
+public:
+
+	/// Prepares the keys of the non-empty cells of a partition, given the
+	/// key of the partitioned secrets.
+	CellHashes(key_type hash, const CodewordPartition &cells,
+		const std::array<int,Feedback::MaxOutcomes> &responses,
+		size_t nresponses)
+		: _cells(cells), _responses(responses), _count(nresponses),
+		_hash(hash)
+	{
+		std::fill(_known, _known + nresponses, false);
+	}
+
+	/// Returns the key of the cell at position @c j in the responses.
+	key_type operator [] (size_t j)
+	{
+		assert(j < _count);
+		if (_known[j])
+			return _keys[j];
+
+		CodewordConstRange cell = _cells[_responses[j]];
+		bool derive = false;
+		if (j + 1 == _count)
+		{
+			size_t others = 0;
+			for (size_t k = 0; k < j; ++k)
+			{
+				if (!_known[k])
+					others += _cells[_responses[k]].size();
+			}
+			derive = others < cell.size();
+		}
+
+		key_type key = derive ? _hash : TranspositionTable::hash_set(cell);
+		for (size_t k = 0; derive && k < j; ++k)
+			key ^= (*this)[k];
+		_keys[j] = key;
+		_known[j] = true;
+		return key;
+	}
+};
+
+/**
+ * Looks for a cell among those already solved that is mapped onto the
+ * given cell by a symmetry of the state before the guess.
+ *
+ * @param solved Positions (in @c responses) of the cells solved so far
+ *      by recursion, in the order they were solved.
+ * @returns The position of the symmetric cell in @c responses, or -1 if
+ *      none is found.
+ */
+static size_t find_symmetric_cell(
+	const EquivalenceFilter *filter,
+	const CodewordPartition &cells,
+	const std::array<int,Feedback::MaxOutcomes> &responses,
+	const std::vector<size_t> &solved,
+	CodewordConstRange cell,
+	CodewordPermutation &perm)
+{
+#if SYMMETRIC_CELLS
+	for (size_t i = 0; i < solved.size(); ++i)
+	{
+		const CodewordRange &other = cells[responses[solved[i]]];
+		if (other.size() == cell.size() &&
+			filter->find_symmetry(other, cell, perm))
+		{
+			UPDATE_CALL_COUNTER("OptimalSymmetricCells", (int)cell.size());
+			return solved[i];
+		}
+	}
+#endif
+	return (size_t)-1;
+}
+
+/**
+ * Returns the cost of an optimal strategy for at most three secrets. Two
+ * secrets cost 3 steps; three secrets cost 5 steps if one of them tells
+ * the other two apart, and 6 steps otherwise.
+ */
+static StrategyCost small_cell_cost(const Engine *e, const Codeword secrets[], size_t n)
+{
+	assert(n >= 1 && n <= 3);
+	if (n == 1)
+		return StrategyCost(1, 1, 1);
+	if (n == 2)
+		return StrategyCost(3, 2, 1);
+	for (size_t i = 0; i < 3; ++i)
+	{
+		if (e->compare(secrets[i], secrets[(i+1)%3]) !=
+			e->compare(secrets[i], secrets[(i+2)%3]))
+			return StrategyCost(5, 2, 2);
+	}
+	return StrategyCost(6, 3, 1);
+}
+
+/**
+ * Solves a small set of secrets in closed form, without searching.
+ *
+ * A guess that splits the secrets into cells of at most three secrets
+ * has an exact cost given by <code>small_cell_cost()</code>. For any
+ * other guess, a lower bound is obtained by estimating its larger cells.
+ * If the best exact cost is no worse than every lower bound, it is the
+ * optimal cost; if every bound reaches the threshold, no strategy is
+ * superior to the threshold. Only the total number of steps is proved.
+ *
+ * The candidates must include every guess allowed, up to symmetry.
+ *
+ * @param best_guess If not NULL, receives the optimal guess that
+ *      <code>fill_strategy_tree()</code> would find, which is the first
+ *      optimal guess in the order the search explores the candidates.
+ *      It is left empty if a guess that is not solved exactly comes
+ *      before every optimal guess in this order and may tie with them.
+ * @returns The optimal cost, including the initial guess, if it is
+ *      superior to the threshold; the threshold if no strategy is
+ *      superior to it; or zero if neither can be proved.
+ */
+static StrategyCost solve_endgame(
+	const Engine *e,
+	CodewordConstRange secrets,       // remaining secrets
+	CodewordConstRange candidates,    // canonical guesses
+	const Heuristics::MinimizeLowerBound &h,
+	const int branching,              // maximum branching factor of the cells
+	const StrategyCost &threshold,    // fails if cost >= threshold (in steps)
+	Codeword *best_guess)             // optimal guess if solved; may be NULL
+{
+	const Feedback perfect = Feedback::perfectValue(e->rules());
+	const unsigned int n = (unsigned int)secrets.size();
+
+	// Lower bound of the cost of a cell of each size, which is exact for
+	// cells of at most three secrets.
+	std::vector<unsigned int> cell_lb(n + 1);
+	for (unsigned int k = 1; k <= n; ++k)
+		cell_lb[k] = (k <= 3)? 2*k-1 : h.estimate(k, branching).steps;
+	if (cell_lb[n] >= threshold.steps)
+		return threshold;
+
+	// Costs are counted after the initial guess. A guess is skipped once
+	// its lower bound reaches the limit, which is the threshold or the best
+	// exact cost found so far. The lowest bound of the guesses skipped for
+	// other reasons must not be below the best exact cost.
+	unsigned int limit = threshold.steps - n;
+	unsigned int open = UNLIMITED_STEPS;
+	StrategyCost best;
+	FeedbackList feedbacks;
+
+	// To find the optimal guess, keep the search score of each candidate,
+	// and its exact cost or the lower bound it was skipped with.
+	const size_t m = best_guess ? candidates.size() : 0;
+	std::vector<lowerbound_t> scores(m);
+	std::vector<unsigned int> bounds(m, UNLIMITED_STEPS);
+	std::vector<bool> solved(m, false);
+
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		FeedbackFrequencyTable freq = e->compare(candidates[i], secrets);
+		if (best_guess)
+			scores[i] = h.compute(freq);
+
+		// A guess that does not split the secrets is never optimal.
+		bool exact = true, triples = false;
+		unsigned int lb = 0;
+		for (size_t k = 0; k < freq.size() && lb < limit; ++k)
+		{
+			if (freq[k] == 0 || k == (size_t)perfect.value())
+				continue;
+			if (freq[k] == n)
+				lb = UNLIMITED_STEPS;
+			else
+				lb += cell_lb[freq[k]];
+			exact = exact && freq[k] <= 3;
+			triples = triples || freq[k] == 3;
+		}
+		if (best_guess)
+			bounds[i] = lb;
+		if (lb >= limit)
+			continue;
+		if (!exact)
+		{
+			open = std::min(open, lb);
+			continue;
+		}
+
+		// Only the cost of a cell of three secrets depends on the secrets.
+		if (triples)
+			e->compare(candidates[i], secrets, feedbacks);
+		StrategyCost cost;
+		for (size_t k = 0; k < freq.size(); ++k)
+		{
+			if (freq[k] == 0 || k == (size_t)perfect.value())
+				continue;
+			Codeword cell[3];
+			for (size_t j = 0, m = 0; freq[k] == 3 && m < 3; ++j)
+			{
+				if (feedbacks[j] == Feedback(k))
+					cell[m++] = secrets[j];
+			}
+			cost += small_cell_cost(e, cell, freq[k]);
+		}
+		if (best_guess)
+		{
+			bounds[i] = cost.steps;
+			solved[i] = true;
+		}
+		if (cost.steps < limit)
+		{
+			best = cost;
+			limit = cost.steps;
+		}
+	}
+
+	if (open < limit)
+		return StrategyCost();
+	UPDATE_CALL_COUNTER("OptimalEndgame", n);
+	if (!best)
+		return threshold;
+
+	// Visit the candidates in the order fill_strategy_tree() explores them
+	// (by score, selecting the lowest remaining one each time), and take
+	// the first that reaches the optimal cost. Stop without a guess at a
+	// candidate whose cost is not known but may be optimal.
+	if (best_guess)
+	{
+		StrategyCostComparer superior(MinSteps);
+		std::vector<int> order(m);
+		std::iota(order.begin(), order.end(), 0);
+		for (size_t index = 0; index < m; ++index)
+		{
+			auto min_it = std::min_element(order.begin() + index, order.end(),
+				[&](int i, int j) -> bool { return superior(scores[i], scores[j]); });
+			std::swap(*min_it, order[index]);
+			int i = order[index];
+			if (bounds[i] > best.steps)
+				continue;
+			if (solved[i])
+				*best_guess = candidates[i];
+			break;
+		}
+	}
+
+	best.steps += n;
+	++best.depth;
+	return best;
+}
+
+/**
+ * Searches for an optimal strategy that starts with the given guess.
+ *
+ * Only the cost of the strategy is computed; the optimal guess of each
+ * subproblem solved is recorded in the transposition table, from which
+ * the strategy tree is reconstructed after the search. The costs and
+ * constraints are measured from the state after making the guess, i.e.
+ * the cost of the initial guess is not included.
+ *
+ * @param threshold On input, the branch pruning threshold. On output, the
+ *      threshold that was last checked against; this is tightened with
+ *      the cost in @c bound (if not NULL) before each cell is processed.
+ * @returns The cost of the strategy if it is superior to the threshold,
+ *      or zero otherwise.
+ */
+static StrategyCost fill_strategy_tree_with_guess(
+	const SearchContext &ctx,
+	CodewordConstRange secrets,       // remaining secrets; not modified
+	TranspositionTable::key_type hash,// hash key of the secrets
+	const Codeword &guess,            // the initial guess to make
+	const lowerbound_t &estimate,     // lower bound estimate of this guess
+	const int branching,              // maximum branching factor of the cells
+	const EquivalenceFilter *filter1, // response-independent equivalence filter
+	const EquivalenceFilter *filter2, // response-dependent equivalence filter
+	const int depth,                  // depth of the current state; root=0
+	StrategyConstraints c,            // constraints after the initial guess
+	StrategyCost &threshold,          // prunes branch if cost >= threshold
+	const SharedBound *bound,         // best cost of sibling guesses
+	HistoryTable *history             // optimal guesses of solved cells; may be NULL
+	)
+{
+	bool verbose = false; // (depth < 1);
+
+	const Engine *e = ctx.e;
+	LowerBoundEstimator &estimator = *ctx.estimator;
+	const StrategyObjective obj = ctx.obj;
+
+	const Feedback perfect = Feedback::perfectValue(e->rules());
+	StrategyCostComparer superior(obj);
+
+	// If there's a limit on the maximum number of guesses allowed,
+	// check if we can prune it.
+	if (estimate.depth > c.max_depth)
+	{
+		if (verbose)
+			std::cout << "Skipped: guess will have too many steps"
+			<< std::endl;
+		return StrategyCost();
+	}
+
+#if 0
+	static size_t test_counter = 0;
+	++test_counter;
+	if (test_counter == 8479)
+	{
+		__debugbreak();
+	}
+#endif
+
+	// Partition a copy of the remaining secrets using this guess. The
+	// secrets are not partitioned in place, so that the strategy found
+	// for each candidate (and therefore the result of the search) does
+	// not depend on which other candidates were examined before it. This
+	// is what makes the parallel search return the same strategy as the
+	// sequential one.
+	//
+	// Partitioning in place used to leave the secrets in the order of the
+	// last candidate examined, and that order broke the ties between
+	// equally good guesses deeper in the tree. The costs are the same
+	// either way, but the optimal tree picked among ties may differ from
+	// the one built before the search was parallelized.
+	CodewordList partitioned(secrets.begin(), secrets.end());
+	CodewordPartition cells = e->partition(partitioned, guess);
+
+	// Sort the partitions by their size, so that smaller partitions
+	// (i.e. smaller search trees) are processed first. This helps
+	// to improve the lower bound (slack) at an earlier stage.
+	std::array<int,Feedback::MaxOutcomes> responses;
+	size_t nresponses = order_cells(cells, responses);
+
+	// Skip this guess if it generates only one response.
+	if (nresponses <= 1)
+	{
+		if (verbose)
+			std::cout << "Skipped: guess produces unit partition"
+			<< std::endl;
+		return StrategyCost();
+	}
+	CellHashes cell_hashes(hash, cells, responses, nresponses);
+
+	// Estimate a lower bound of the cost of revealing the secrets in 
+	// each partition, NOT counting the cost of making the initial guess.
+	// If the total lower bound reaches or exceeds the cut-off threshold,
+	// we can prune this guess.
+	// Note: this step is redundant because we have already calculated
+	// the same score before.
+	StrategyCost lb_part[256];
+	StrategyCost lb;
+	for (size_t j = 0; j < nresponses; ++j)
+	{
+		Feedback feedback = Feedback(responses[j]);
+		if (feedback != perfect)
+		{
+			lowerbound_t estimate = estimator.heuristic().estimate(
+				(int)cells[feedback.value()].size(), branching);
+			lb_part[j] = estimate;
+			lb += lb_part[j];
+		}
+	}
+
+	// Since this is a double-computation, we shouldn't be pruning
+	// this guess here. The estimate only carries the parts of the cost
+	// that the objective takes into account.
+	assert(!superior(lb, estimate) && !superior(estimate, lb));
+
+	// Replace the estimates of small cells by their exact cost if they
+	// are found in the tablebase, and prune the guess if the tightened
+	// lower bound reaches the threshold.
+	if (ctx.tb)
+	{
+		for (size_t j = 0; j < nresponses; ++j)
+		{
+			Feedback feedback = Feedback(responses[j]);
+			const CodewordRange &cell = cells[feedback.value()];
+			StrategyCost cell_cost;
+			Codeword cell_guess;
+			if (feedback != perfect && c.max_depth >= cell.size() &&
+				ctx.tb->lookup(cell, cell_cost, cell_guess))
+			{
+				lb_part[j] = cell_cost;
+			}
+		}
+		lb = aggregate_cost(lb_part, nresponses);
+		if (!superior(lb, threshold))
+		{
+			if (verbose)
+				std::cout << "Skipped: tablebase lower bound >= cut-off"
+				<< std::endl;
+			return StrategyCost();
+		}
+	}
+
+	if (verbose)
+	{
+		std::cout << nresponses << " cells:";
+		for (size_t j = 0; j < nresponses; ++j)
+		{
+			if (j > 0)
+				std::cout << ',';
+			std::cout << cells[responses[j]].size();
+		}
+		std::cout << "; lower bound = " 	<< lb 
+			<< ", cut-off = " << threshold << std::endl;
+	}
+
+	// Find the best guess for each partition. We adopt a two-phase
+	// equivalence filtering method. First, we filter all possible
+	// codewords by (response-indepedent) constraint equivalence.
+	// This can be done once for all response classes. Then, for each
+	// individual response class, we apply the response-dependent 
+	// color equivalence filter.
+	CodewordList pre_filtered;
+	std::unique_ptr<EquivalenceFilter> pre_filter(filter1->clone());
+	size_t solved = 0; // number of secrets in the cells solved so far
+	std::vector<size_t> recursed; // cells solved by recursion
+	pre_filter->add_constraint(guess, Feedback(), e->universe());
+	// @todo we may change the interface of add_constraint to return
+	// a new filter.
+
+	// Start a new history for the cells below this guess if they are
+	// the topmost cells solved sequentially.
+	std::unique_ptr<HistoryTable> local_history;
+	if (ctx.history && depth + 1 == PARALLEL_DEPTH)
+	{
+		local_history.reset(new HistoryTable());
+		history = local_history.get();
+	}
+
+	for (size_t j = 0; j < nresponses; ++j)
+	{
+		Feedback feedback = Feedback(responses[j]);
+		const CodewordRange &cell = cells[feedback.value()];
+
+		// Do not recurse for a perfect match.
+		if (feedback == perfect)
+		{
+			VERBOSE_COUT("- Checking cell " << feedback
+				<< " -> perfect");
+			++solved;
+			continue;
+		}
+
+#if OPTIMAL_PARALLEL
+		// Tighten the threshold if a sibling guess has found a better
+		// strategy in the mean time.
+		if (bound)
+		{
+			StrategyCost global = bound->load();
+			if (superior(global, threshold))
+			{
+				threshold = global;
+				if (!superior(lb, threshold))
+					return StrategyCost();
+			}
+		}
+#endif
+
+		VERBOSE_COUT("- Checking cell " << feedback
+			<< " -> lower bound = " << lb_part[j]);
+
+		// Short-cut if only one additional guess is allowed
+		// but we are left with more than one secret in this
+		// partition.
+		// @todo such pruning could be improved and consolidated with
+		//  the pruning in the beginning of the routine.
+		if (c.max_depth == 1 && cell.size() > 1)
+			return StrategyCost();
+
+		// If there's an obviously optimal guess for this cell, use it.
+		// Otherwise, if the cell is symmetric to a cell already solved,
+		// it has the same cost.
+		StrategyCost cell_cost = obviously_optimal_cost(e, cell, obj, c);
+		CodewordPermutation perm;
+		size_t k;
+		if (!!cell_cost)
+		{
+			//VERBOSE_COUT("- Checking cell " << cell.feedback
+			//	<< " -> found obvious guess");
+			VERBOSE_COUT("  Found obvious guess");
+			if (ctx.stats)
+				ctx.stats->add(depth, &DepthStatistics::obvious, 1);
+		}
+		else if ((k = find_symmetric_cell(filter1, cells, responses,
+			recursed, cell, perm)) != (size_t)-1)
+		{
+			VERBOSE_COUT("  Symmetric to cell " << Feedback(responses[k]));
+			cell_cost = lb_part[k];
+		}
+		else
+		{
+			//VERBOSE_COUT("- Checking cell " << cell.feedback
+			//	<< " -> lower bound = " << lb);
+			//VERBOSE_COUT("- Checking cell " << cell.feedback
+			//	<< " -> lower bound = " << lb_part[j]);
+
+			// @todo: estimate a lower bound of the cost of any guess.
+			// If the lower bound is greater than the cut-off, we don't
+			// need to proceed any more.
+
+			// Apply constraint filter on the candidate guesses if not 
+			// already done so. This filter does not depend on the response,
+			// so a single run can be used for all response classes.
+			if (pre_filtered.empty())
+			{
+				if (c.pos_only)
+					pre_filtered = pre_filter->get_canonical_guesses(partitioned);
+				else
+					pre_filtered = pre_filter->generate_canonical_guesses(e);
+			}
+
+			// Apply color filter on the pre-filtered candidates.
+			std::unique_ptr<EquivalenceFilter> new_filter(filter2->clone());
+			new_filter->add_constraint(guess, feedback, cell);
+			CodewordList canonical = new_filter->get_canonical_guesses(pre_filtered);
+
+			// The threshold of this cell is what is left of the overall
+			// threshold after the lower bounds of the other cells.
+			StrategyCost t = cell_threshold(threshold,
+				aggregate_cost(lb_part, nresponses, j), obj);
+			if (!t)
+				return StrategyCost();
+
+#if ENDGAME_SOLVER
+			// The endgame solver proves the optimal cost of the cell over
+			// all strategies, which is what the search finds when there is
+			// room for any strategy within the depth limit.
+			if (obj == MinSteps && c.max_depth >= cell.size() &&
+				cell.size() <= (size_t)(ENDGAME_SIZE_FACTOR *
+				(estimator.heuristic().branching_factor() + 1)))
+			{
+				cell_cost = solve_endgame(e, cell, canonical,
+					estimator.heuristic(), branching, t, NULL);
+			}
+#endif
+			if (!!cell_cost)
+			{
+				VERBOSE_COUT("  Solved in closed form");
+				if (ctx.stats)
+					ctx.stats->add(depth, &DepthStatistics::endgame, 1);
+				if (!superior(cell_cost, t))
+					return StrategyCost();
+			}
+			else
+			{
+				TranspositionTable::key_type cell_hash =
+					(ctx.tt || ctx.checkpoint || ctx.upper_bounds) ?
+					cell_hashes[j] : 0;
+				Codeword cell_guess;
+				cell_cost = fill_strategy_tree(ctx, cell, cell_hash, canonical,
+					pre_filter.get(), new_filter.get(),
+					depth + 1, c, t, history, cell_guess);
+				recursed.push_back(j);
+			}
+		}
+
+		if (!cell_cost) // No strategy was found for this cell
+		{
+			VERBOSE_COUT("Pruned this guess because the recursion returns -1.");
+			return StrategyCost();
+		}
+
+#if 1
+		if (superior(lb_part[j], cell_cost))
+			VERBOSE_COUT("  Cell optimal cost is " << cell_cost);
+		else if (superior(cell_cost, lb_part[j]))
+			VERBOSE_COUT("  ERROR: LOWER BOUND IS HIGHER THAN ACTUAL COST.");
+		else
+			VERBOSE_COUT("  Lower bound unchanged.");
+#endif
+
+		// Refine the lower bound estimate.
+		lb_part[j] = cell_cost;
+		lb = aggregate_cost(lb_part, nresponses);
+
+		// Report the progress of exploring an initial guess.
+		solved += cell.size();
+		if (ctx.progress && depth == 0)
+			ctx.progress->update(guess, (double)solved / secrets.size());
+
+		if (!superior(lb, threshold))
+		{
+			VERBOSE_COUT("Skipping " << (nresponses-j-1) << " remaining "
+				<< "partitions because lower bound (" << lb << ") >= cut-off ("
+				<< threshold << ")");
+			return StrategyCost();
+		}
+	}
+	return lb;
+}
+
+#if OPTIMAL_PARALLEL
+/**
+ * Explores the candidate guesses of a node in parallel, and stores the
+ * best guess found in @c best_guess.
+ *
+ * The candidates are given in the order the sequential search would
+ * explore them, and the result is identical to that of the sequential
+ * search: the first candidate in this order that achieves the optimal
+ * cost wins.
+ *
+ * @returns The cost of the best strategy found, not counting the initial
+ *      guess, or zero if no strategy is superior to the threshold.
+ */
+static StrategyCost fill_strategy_tree_parallel(
+	const SearchContext &ctx,
+	CodewordConstRange secrets,       // remaining secrets; not modified
+	TranspositionTable::key_type hash,// hash key of the secrets
+	CodewordRange candidates,         // canonical guesses
+	const std::vector<lowerbound_t> &scores, // lower bound of each candidate
+	const int branching,              // maximum branching factor of the cells
+	const std::vector<int> &order,    // order to explore the candidates
+	const EquivalenceFilter *filter1, // response-independent equivalence filter
+	const EquivalenceFilter *filter2, // response-dependent equivalence filter
+	const int depth,                  // depth of the current state; root=0
+	StrategyConstraints c,            // constraints after the initial guess
+	StrategyCost threshold,           // prunes branch if cost >= threshold
+	HistoryTable *history,            // history of the sequential search above
+	Codeword &best_guess              // the best guess
+	)
+{
+	const StrategyObjective obj = ctx.obj;
+	StrategyCostComparer superior(obj);
+	const size_t n = order.size();
+
+	// The threshold each candidate was cut off against, or zero if the
+	// candidate was not cut off.
+	std::vector<StrategyCost> cutoff(n);
+
+	SharedBound bound(threshold, obj);
+	StrategyCost best;
+	size_t best_pos = n;
+
+	for (size_t pos = 0; pos < n; ++pos)
+	{
+		// Candidates are ordered by their lower bound; so once a candidate
+		// is pruned, all the remaining ones are pruned too.
+		StrategyCost t = bound.load();
+		if (!superior(scores[order[pos]], t))
+		{
+			if (ctx.stats)
+				ctx.stats->add(depth, &DepthStatistics::pruned_bound, n - pos);
+			std::fill(cutoff.begin() + pos, cutoff.end(), t);
+			for (size_t k = pos; ctx.progress && depth == 0 && k < n; ++k)
+				ctx.progress->update(candidates[order[k]], 1.0);
+			break;
+		}
+
+		#pragma omp task default(shared) firstprivate(pos)
+		{
+			int i = order[pos];
+			StrategyCost t = bound.load();
+			lowerbound_t lb = tighter_bound(ctx, secrets, candidates[i],
+				scores[i], branching);
+			if (!superior(lb, t))
+			{
+				cutoff[pos] = t;
+				if (ctx.stats)
+					ctx.stats->add(depth, &DepthStatistics::pruned_bound, 1);
+			}
+			else
+			{
+				StrategyCost cost = fill_strategy_tree_with_guess(ctx, secrets, hash,
+					candidates[i], lb, branching, filter1, filter2,
+					depth, c, t, &bound, history);
+				if (ctx.stats)
+				{
+					ctx.stats->add(depth, &DepthStatistics::explored, 1);
+					ctx.stats->add(depth, &DepthStatistics::pruned_threshold, !cost);
+				}
+				if (!cost)
+				{
+					cutoff[pos] = t;
+				}
+				else
+				{
+					#pragma omp critical (OptimalCodeBreaker_Best)
+					{
+						if (best_pos == n || superior(cost, best) ||
+							(!superior(best, cost) && pos < best_pos))
+						{
+							best = cost;
+							best_pos = pos;
+							bound.improve(best);
+						}
+					}
+				}
+			}
+			if (ctx.progress && depth == 0)
+				ctx.progress->update(candidates[i], 1.0);
+		}
+	}
+	#pragma omp taskwait
+
+	// A task accepts a guess only if it is strictly superior to the best
+	// one found so far, but the tasks may finish in any order. Re-examine
+	// the candidates that precede the best one and were cut off at exactly
+	// the best cost, so that ties are broken the same way as sequentially.
+	for (size_t pos = 0; pos < best_pos && best_pos < n; ++pos)
+	{
+		if (!cutoff[pos] || superior(best, cutoff[pos]))
+			continue;
+
+		int i = order[pos];
+		StrategyCost t = successor(best, obj);
+		lowerbound_t lb = tighter_bound(ctx, secrets, candidates[i],
+			scores[i], branching);
+		if (!superior(lb, t))
+			continue;
+
+		StrategyCost cost = fill_strategy_tree_with_guess(ctx, secrets, hash,
+			candidates[i], lb, branching, filter1, filter2,
+			depth, c, t, NULL, history);
+		if (ctx.stats)
+		{
+			ctx.stats->add(depth, &DepthStatistics::explored, 1);
+			ctx.stats->add(depth, &DepthStatistics::pruned_threshold, !cost);
+		}
+		if (!!cost)
+		{
+			best = cost;
+			best_pos = pos;
+			break;
+		}
+	}
+	if (best_pos < n)
+		best_guess = candidates[order[best_pos]];
+	return best;
+}
+#endif
+
+/**
+ * Searches for an optimal strategy for the given set of remaining secrets.
+ *
+ * @param depth Depth of the current state. This is equal to the number of 
+ *      guesses already made.
+ * @param threshold Branch pruning threshold. If the cost of revealing all
+ *      the secrets would reach or exceed this threshold, the function will
+ *      fail. This parameter should be set to the currently best cost achieved
+ *      by some known strategy.
+ * @returns The cost of the optimal strategy if one is found, or zero if 
+ *      one is not found either because some secret would require more than
+ *      <code>c.max_depth</code> guesses to reveal, or because the cost of
+ *      any strategy would reach or exceed the cut-off threshold.
+ *
+ * Only the cost and the first guess of the optimal strategy are computed;
+ * use <code>replay_strategy_tree()</code> to build the strategy tree.
+ */
+// @todo: We might change the equivalence filter interface to operate on
+// the input inplace? This could save a few memory copies but may change
+// the output.
+// all the secrets, or -1 if such optimal will not be less than _best_.
+static StrategyCost fill_strategy_tree(
+	const SearchContext &ctx,
+	CodewordRange secrets,            // remaining secrets; not modified
+	TranspositionTable::key_type hash,// hash key of the secrets
+	CodewordRange candidates,         // canonical guesses; may be sorted
+	const EquivalenceFilter *filter1, // response-independent equivalence filter
+	const EquivalenceFilter *filter2, // response-dependent equivalence filter
+	const int depth,                  // depth of the current state; root=0
+	StrategyConstraints c,            // constraints
+	StrategyCost threshold,           // prunes branch if cost >= threshold
+	HistoryTable *history,            // optimal guesses of solved subproblems; may be NULL
+	Codeword &best_guess              // the optimal guess if one is found
+	)
+{
+	UPDATE_CALL_COUNTER("OptimalRecursion", (int)secrets.size());
+
+	bool verbose = false; // (depth < 1);
+
+	LowerBoundEstimator &estimator = *ctx.estimator;
+	const StrategyObjective obj = ctx.obj;
+
+	VERBOSE_COUT("Checking " << secrets.size() << " remaining secrets");
+
+	// Fail if the secret set is empty or the max-depth is 0.
+	if (secrets.empty() || c.max_depth == 0)
+		return StrategyCost();
+
+	// Initialize common variables.
+	const unsigned int nsecrets = (int)secrets.size();
+
+	// Short-cut if there is only one secret.
+	if (nsecrets == 1)
+	{
+		best_guess = secrets[0];
+		return StrategyCost(1, 1, 1);
+	}
+
+	// Define a strategy cost comparer.
+	StrategyCostComparer superior(obj);
+
+	// Fail if the secrets cannot be revealed within the depth limit, or
+	// below the threshold, even if every guess splits the secrets into
+	// as many cells as possible. This saves scoring the candidates.
+	lowerbound_t simple = estimator.heuristic().simple_estimate(nsecrets);
+	if (simple.depth > c.max_depth || !superior(simple, threshold))
+		return StrategyCost();
+
+	// If a known strategy reveals the same secrets within the depth limit,
+	// an optimal strategy is no worse than it. Tighten the threshold so
+	// that only such strategies are accepted.
+	if (ctx.upper_bounds)
+	{
+		UpperBoundMap::const_iterator it = ctx.upper_bounds->find(hash);
+		bool tightened = false;
+		if (it != ctx.upper_bounds->end() && it->second.depth <= c.max_depth)
+		{
+			StrategyCost t = successor(it->second, obj);
+			if (superior(t, threshold))
+			{
+				threshold = t;
+				tightened = true;
+			}
+		}
+		UPDATE_CALL_COUNTER("OptimalBootstrap_Tightened", tightened ? 1 : 0);
+	}
+
+	// Look up this subproblem in the transposition table. If the optimal
+	// cost (or a lower bound of it) is known to be no better than the
+	// threshold, fail right away.
+	TranspositionTable::Entry entry;
+	entry.key = TranspositionTable::combine(hash,
+		TranspositionTable::hash_sequence(candidates), c.max_depth);
+	bool found = ctx.tt && ctx.tt->lookup(entry.key, nsecrets, entry);
+	if (found && !superior(entry.cost, threshold))
+		return StrategyCost();
+	if (found && entry.type == TranspositionTable::Exact)
+	{
+		best_guess = Codeword::unpack(entry.guess);
+		return entry.cost;
+	}
+	const StrategyCost original_threshold = threshold;
+
+	// Reuse the result journaled by an interrupted search, if any. Like an
+	// entry in the transposition table, the result is either the optimal
+	// cost and guess, or a threshold that the search failed against.
+	const bool use_checkpoint = ctx.checkpoint && depth <= CHECKPOINT_DEPTH;
+	Checkpoint::Entry saved;
+	if (use_checkpoint && ctx.checkpoint->lookup(entry.key, saved))
+	{
+		if (!superior(saved.cost, threshold))
+			return StrategyCost();
+		if (saved.exact)
+		{
+			best_guess = Codeword::unpack(saved.guess);
+			return saved.cost;
+		}
+	}
+
+	// Look up the set in the endgame tablebase. Its entries are exact
+	// only if the depth constraint cannot be binding, which is the case
+	// if at least one guess is allowed for each secret.
+	const bool use_tablebase = ctx.tb && ctx.tb->covers(nsecrets) &&
+		c.max_depth >= nsecrets;
+	if (use_tablebase)
+	{
+		StrategyCost cost;
+		Codeword guess;
+		if (ctx.tb->lookup(secrets, cost, guess))
+		{
+			if (!superior(cost, threshold))
+				return StrategyCost();
+			best_guess = guess;
+			return cost;
+		}
+	}
+
+	// From now on, we will need to make at least one guess to reveal any 
+	// secret, and at least two guesses to reveal all secrets. This accounts
+	// for n total steps and 1 extra step. 
+	
+	// Update the constraints and threshold so that they will apply to a 
+	// situation after the initial guess.
+	if (c.max_depth == 1)
+		return StrategyCost();
+	else
+		--c.max_depth;
+
+	if (threshold.steps <= nsecrets)
+		return StrategyCost();
+	else
+		threshold.steps -= nsecrets;
+
+	// The initial guess adds one to the depth of every secret but the one
+	// it reveals, which is never the deepest. So the worst count of the
+	// threshold is unchanged. A zero depth stays zero: it only accepts
+	// strategies with fewer steps, both before and after the guess.
+	if (threshold.depth > 0)
+		--threshold.depth;
+
+#if 0
+	// If find_last is true, then we only cut-off a guess when it's
+	// strictly worse than the current best; otherwise, we cut-off
+	// a guess as long as it's no better than the current best.
+	int cut_off_delta = (c.find_last? 1 : 0);
+	cut_off += cut_off_delta ???
+#endif
+
+	// Filter canonical guesses as candidates.
+	//CodewordList candidates = filter->get_canonical_guesses(e.universe());
+	//VERBOSE_COUT("Found " << candidates.size() << " canonical guesses.");
+
+	// Compute a lower bound of the cost for each candidate guess, exluding
+	// the cost of making the initial guess because this is the same for all
+	// candidates. Then sort the candidates by this lower bound so that more
+	// "promising" candidates are processed first. This helps to improve the
+	// upper bound as early as possible.
+	// @todo It might be better to rename scores to extra_cost.
+	util::hr_timer timer;
+	if (ctx.stats)
+	{
+		timer.start();
+		ctx.stats->add(depth, &DepthStatistics::nodes, 1);
+		ctx.stats->add(depth, &DepthStatistics::candidates, candidates.size());
+	}
+	std::vector<lowerbound_t> scores(candidates.size());
+	//estimator.make_guess(secrets, candidates, scores.data());
+	const int branching = score_candidates(ctx, secrets, candidates, scores.data());
+
+	// @todo We might opt to remove the need to create an index array.
+	// Instead, we could scan for the element in each iteration.
+	std::vector<int> order(candidates.size());
+	std::iota(order.begin(), order.end(), 0);
+
+	// Break ties in the lower bound by the history of each candidate,
+	// which is looked up the first time it is needed.
+	std::vector<int> history_score(history ? candidates.size() : 0, -1);
+	auto better = [&](int i, int j) -> bool {
+		if (superior(scores[i], scores[j]))
+			return true;
+		if (superior(scores[j], scores[i]) || !history)
+			return false;
+		if (history_score[i] < 0)
+			history_score[i] = (int)history->score(candidates[i], depth);
+		if (history_score[j] < 0)
+			history_score[j] = (int)history->score(candidates[j], depth);
+		return history_score[i] > history_score[j];
+	};
+
+	// Define SORT_CANDIDATES to 1 to explicitly sort the candidate guesses.
+	// Since many guesses will be pruned right away (especially if we have
+	// a good estimate of the lower-bound of the cost), it is usually faster
+	// to (linearly) search for the smallest element in each iteration,
+	// instead of sorting the whole array at the beginning. However, the
+	// results will be the same as long as we perform a stable sort.
+#define SORT_CANDIDATES 0
+
+#if SORT_CANDIDATES
+	std::sort(order.begin(), order.end(), [&](int i, int j) -> bool {
+		if (better(i, j))
+			return true;
+		if (better(j, i))
+			return false;
+		return i < j;
+	});
+#endif
+
+	// Find the guess with the lowest estimated cost in the remaining
+	// candidates, and swap it to the front.
+	auto select_next = [&](size_t index) {
+#if !SORT_CANDIDATES
+		auto min_it = std::min_element(order.begin() + index, order.end(), better);
+		std::swap(*min_it, order[index]);
+#endif
+	};
+
+	// Initialize state variables to store the best guess and its cost so far.
+	StrategyCost best;
+
+#if OPTIMAL_PARALLEL
+	if (depth < PARALLEL_DEPTH && omp_in_parallel())
+	{
+		// Fix the exploration order up-front so that the parallel search
+		// returns the same strategy as the sequential one.
+		for (size_t index = 0; index < order.size(); ++index)
+			select_next(index);
+		best = fill_strategy_tree_parallel(ctx, secrets, hash, candidates, scores,
+			branching, order, filter1, filter2, depth, c, threshold, history, best_guess);
+	}
+	else
+#endif
+	{
+		// The history only changes the order in which candidates of equal
+		// lower bound are explored, not the guess found: as without history,
+		// the optimal guess that comes first in the order of lower bound and
+		// then position wins. A candidate that precedes the best guess so
+		// far in this order is therefore accepted if it merely ties.
+		size_t best_i = 0;
+		auto precedes = [&](size_t i, size_t j) -> bool {
+			return superior(scores[i], scores[j]) ||
+				(!superior(scores[j], scores[i]) && i < j);
+		};
+
+		// Try each candidate guess.
+		size_t candidate_count = candidates.size();
+		for (size_t index = 0; index < candidate_count; ++index)
+		{
+			select_next(index);
+			size_t i = order[index];
+			Codeword guess = candidates[i];
+			StrategyCost t = threshold;
+			bool tie_wins = history && !!best && precedes(i, best_i);
+			if (tie_wins)
+				t = successor(best, obj);
+
+			// Since we keep improving the upper bound dynamically,
+			// and we sort the candidates by their lower bound,
+			// we need to check here whether the remaining candidates
+			// are still worth checking.
+			if (!superior(scores[i], t))
+			{
+				// The remaining candidates that precede the best guess
+				// may still tie with it. Try them in order of position.
+				if (history && !!best && !tie_wins)
+				{
+					std::vector<int> ties;
+					for (size_t k = index; k < candidate_count; ++k)
+					{
+						if (superior(scores[order[k]], successor(best, obj)) &&
+							precedes(order[k], best_i))
+							ties.push_back(order[k]);
+					}
+					std::sort(ties.begin(), ties.end());
+					for (size_t k = 0; k < ties.size(); ++k)
+					{
+						StrategyCost tie = successor(best, obj);
+						lowerbound_t lb = tighter_bound(ctx, secrets,
+							candidates[ties[k]], scores[ties[k]], branching);
+						if (!superior(lb, tie))
+							continue;
+						StrategyCost cost = fill_strategy_tree_with_guess(ctx,
+							secrets, hash, candidates[ties[k]], lb,
+							branching, filter1, filter2, depth, c, tie, NULL,
+							history);
+						if (ctx.stats)
+						{
+							ctx.stats->add(depth, &DepthStatistics::explored, 1);
+							ctx.stats->add(depth, &DepthStatistics::pruned_threshold, !cost);
+						}
+						if (!!cost)
+						{
+							best_guess = candidates[ties[k]];
+							break;
+						}
+					}
+				}
+
+				if (ctx.stats)
+				{
+					ctx.stats->add(depth, &DepthStatistics::pruned_bound,
+						candidate_count - index);
+				}
+				for (size_t k = index; ctx.progress && depth == 0 && k < candidate_count; ++k)
+					ctx.progress->update(candidates[order[k]], 1.0);
+				VERBOSE_COUT("Pruned " << (candidate_count - index)
+					<< " remaining guesses: lower bound (" << scores[i]
+					<< ") >= cut-off (" << threshold << ")");
+#if 0
+				if (i == 0)
+				{
+					std::cout << "Very first pruned: best lower bound = "
+						<< scores[i] << ", cut-off = " << cut_off << std::endl;
+				}
+#endif
+				break;
+			}
+
+			// The tighter bound of this candidate may still reach the
+			// threshold, though that of the candidates after it may not.
+			lowerbound_t lb = tighter_bound(ctx, secrets, guess, scores[i],
+				branching);
+			if (!superior(lb, t))
+			{
+				if (ctx.stats)
+					ctx.stats->add(depth, &DepthStatistics::pruned_bound, 1);
+				if (ctx.progress && depth == 0)
+					ctx.progress->update(guess, 1.0);
+				continue;
+			}
+
+			VERBOSE_COUT("Checking guess " << (i+1) << " of "
+				<< candidate_count << " (" << guess << ") -> ");
+
+			StrategyCost cost = fill_strategy_tree_with_guess(ctx, secrets, hash,
+				guess, lb, branching, filter1, filter2, depth, c, t, NULL,
+				history);
+			if (ctx.progress && depth == 0)
+				ctx.progress->update(guess, 1.0);
+			if (ctx.stats)
+			{
+				ctx.stats->add(depth, &DepthStatistics::explored, 1);
+				ctx.stats->add(depth, &DepthStatistics::pruned_threshold, !cost);
+			}
+
+			// Now the guess is either pruned, or is the best guess so far.
+			if (!!cost)
+			{
+				assert(tie_wins || superior(cost, threshold));
+				assert(!best || superior(cost, best) || tie_wins);
+				best = cost;
+				best_guess = guess;
+				best_i = i;
+				threshold = best;
+				VERBOSE_COUT("Improved cut-off to " << best);
+			}
+		}
+	}
+
+	// Record how far the lowest lower bound (which is that of the first
+	// candidate explored) was from the optimal cost.
+	if (ctx.stats)
+	{
+		if (!!best)
+		{
+			ctx.stats->add(depth, &DepthStatistics::solved, 1);
+			ctx.stats->add(depth, &DepthStatistics::first_best,
+				best_guess == candidates[order[0]]);
+			ctx.stats->add(depth, &DepthStatistics::bound_gap,
+				best.steps - scores[order[0]].steps);
+		}
+		ctx.stats->add_time(depth, timer.stop());
+	}
+
+	// Let the winning guess be tried earlier in the subproblems to come.
+	if (history && !!best)
+		history->record(best_guess, depth, nsecrets);
+
+	// Since 'best' is calculated without accounting for the initial guess,
+	// we need to add it back.
+	if (!!best)
+	{
+		best.steps += nsecrets;
+		++best.depth;
+	}
+
+	// Journal the result, so that a resumed search need not solve this
+	// subproblem again.
+	if (use_checkpoint)
+	{
+		if (!!best)
+			ctx.checkpoint->record(entry.key, best, best_guess);
+		else
+			ctx.checkpoint->record_failure(entry.key, original_threshold);
+	}
+
+	// Store the optimal cost and guess of a small set in the tablebase.
+	if (use_tablebase && !!best)
+		ctx.tb->store(secrets, best, best_guess);
+
+	// Store the result in the transposition table: either the optimal
+	// cost and guess, or the threshold that the search failed against.
+	if (ctx.tt)
+	{
+		if (!!best)
+		{
+			entry.type = TranspositionTable::Exact;
+			entry.cost = best;
+			entry.guess = best_guess.pack();
+		}
+		else
+		{
+			entry.type = TranspositionTable::LowerBound;
+			entry.cost = original_threshold;
+		}
+		entry.size = nsecrets;
+		ctx.tt->store(entry, obj);
+	}
+	return best;
+}
+
+/**
+ * Searches for an optimal strategy for a state below the given threshold.
+ * If multiple threads are available, the top levels of the search are
+ * explored by tasks that are spawned from a single thread.
+ */
+static StrategyCost probe_state(
+	const SearchContext &ctx,
+	CodewordRange secrets,
+	TranspositionTable::key_type hash,
+	CodewordRange candidates,
+	const EquivalenceFilter *filter1,
+	const EquivalenceFilter *filter2,
+	const int depth,
+	StrategyConstraints c,
+	StrategyCost threshold,
+	Codeword &best_guess)
+{
+	StrategyCost best;
+#if OPTIMAL_PARALLEL
+	if (omp_get_max_threads() > 1)
+	{
+		#pragma omp parallel
+		#pragma omp single
+		best = fill_strategy_tree(ctx, secrets, hash, candidates,
+			filter1, filter2, depth, c, threshold, NULL, best_guess);
+	}
+	else
+#endif
+	{
+		best = fill_strategy_tree(ctx, secrets, hash, candidates,
+			filter1, filter2, depth, c, threshold, NULL, best_guess);
+	}
+	return best;
+}
+
+
+/**
+ * Searches for an optimal strategy for a state with no pruning threshold.
+ *
+ * If <code>ctx.mtd</code> is set, the state is solved by a series of
+ * searches with narrow thresholds (as in MTD), which prune much more than
+ * a single search with no threshold. The first threshold just accepts the
+ * lowest lower bound of the candidates; each failed search proves that
+ * the optimal cost reaches its threshold, and the next threshold is placed
+ * twice as far above the lower bound. The first search that succeeds
+ * returns the exact optimal cost. The searches that fail leave lower
+ * bounds in the transposition table, which the following searches reuse.
+ * The strategy found is the same as that of a single search.
+ */
+static StrategyCost solve_state(
+	const SearchContext &ctx,
+	CodewordRange secrets,
+	TranspositionTable::key_type hash,
+	CodewordRange candidates,
+	const EquivalenceFilter *filter1,
+	const EquivalenceFilter *filter2,
+	const int depth,
+	StrategyConstraints c,
+	Codeword &best_guess)
+{
+	const StrategyCost unlimited(UNLIMITED_STEPS, 100, 0);
+	if (!ctx.mtd || secrets.size() <= 1 || candidates.empty())
+	{
+		return probe_state(ctx, secrets, hash, candidates, filter1, filter2,
+			depth, c, unlimited, best_guess);
+	}
+
+	// The lowest lower bound of any candidate, including the initial guess.
+	std::vector<lowerbound_t> scores(candidates.size());
+	int branching = score_candidates(ctx, secrets, candidates, scores.data());
+	unsigned int lb = UNLIMITED_STEPS;
+	for (size_t i = 0; i < scores.size(); ++i)
+	{
+		lb = std::min(lb, tighter_bound(ctx, secrets, candidates[i],
+			scores[i], branching).steps);
+	}
+	lb += (unsigned int)secrets.size();
+
+	for (unsigned int width = 1; ; width *= 2)
+	{
+		// Probe with a threshold that accepts costs up to lb + width - 1.
+		// The last probe has no threshold, so that a state that has no
+		// strategy within the depth limit is still failed.
+		bool last = (lb + width >= UNLIMITED_STEPS);
+		StrategyCost threshold = last ? unlimited : StrategyCost(lb + width, 0, 0);
+		if (ctx.progress)
+		{
+			std::cerr << "Probing with threshold " << threshold.steps
+				<< std::endl;
+		}
+		UPDATE_CALL_COUNTER("OptimalMTD_Probes", width);
+		StrategyCost best = probe_state(ctx, secrets, hash, candidates,
+			filter1, filter2, depth, c, threshold, best_guess);
+		if (!!best || last)
+			return best;
+	}
+}
+
+/**
+ * Creates the lower-bound heuristic of a search. If requested, the
+ * estimate is tightened with an upper bound of the number of secrets
+ * that can be revealed within a given number of guesses.
+ */
+static Heuristics::MinimizeLowerBound make_heuristic(
+	const Engine *e,
+	const EquivalenceFilter *filter,
+	StrategyObjective obj,
+	const OptimalSearchOptions &options)
+{
+	if (options.counting_bound > 0)
+	{
+		return Heuristics::MinimizeLowerBound(e, Heuristics::max_breakable_within(
+			e, filter, options.counting_bound), obj);
+	}
+	return Heuristics::MinimizeLowerBound(e, obj);
+}
+
+/// Number of seconds to wait between two checks of the jobs being solved
+/// by other workers.
+#define JOB_POLL_INTERVAL 1
+
+/**
+ * Solves the subproblem of a job, i.e. the state after making the initial
+ * guess @c guess and receiving the response @c response, exactly in the
+ * same way as <code>fill_strategy_tree_with_guess()</code> would. The
+ * results are journaled to @c journal, from which the search picks them
+ * up.
+ */
+static void solve_job(
+	SearchContext ctx,
+	const CompositeEquivalenceFilter &filter,
+	const CodewordList &all,
+	StrategyConstraints c,
+	const Codeword &guess,
+	Feedback response,
+	Checkpoint *journal)
+{
+	const Engine *e = ctx.e;
+	CodewordList partitioned(all);
+	CodewordPartition cells = e->partition(partitioned, guess);
+	CodewordRange cell = cells[response.value()];
+
+	std::unique_ptr<EquivalenceFilter> pre_filter(filter.first()->clone());
+	pre_filter->add_constraint(guess, Feedback(), e->universe());
+	CodewordList pre_filtered = c.pos_only ?
+		pre_filter->get_canonical_guesses(partitioned) :
+		pre_filter->generate_canonical_guesses(e);
+	std::unique_ptr<EquivalenceFilter> new_filter(filter.second()->clone());
+	new_filter->add_constraint(guess, response, cell);
+	CodewordList canonical = new_filter->get_canonical_guesses(pre_filtered);
+
+	ctx.checkpoint = journal;
+	--c.max_depth;
+	Codeword cell_guess;
+	solve_state(ctx, cell, TranspositionTable::hash_set(cell), canonical,
+		pre_filter.get(), new_filter.get(), 1, c, cell_guess);
+}
+
+/**
+ * Claims and solves the jobs in a job directory that are still waiting,
+ * one at a time, and writes the journal of each to its result file. A job
+ * that cannot be solved is marked as failed, so that the search that
+ * posted it does not wait for it.
+ *
+ * @returns The number of jobs solved.
+ */
+static size_t run_jobs(
+	const SearchContext &ctx,
+	const CompositeEquivalenceFilter &filter,
+	const CodewordList &all,
+	StrategyConstraints constraints,
+	JobDirectory &dir,
+	const std::vector<std::string> &names,
+	bool verbose)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < names.size(); ++i)
+	{
+		std::string description;
+		if (!dir.claim(names[i], description))
+			continue;
+
+		std::istringstream ss(description);
+		Codeword::compact_type guess;
+		size_t response;
+		if (!(ss >> std::hex >> guess >> std::dec >> response) ||
+			response >= Feedback::MaxOutcomes)
+		{
+			std::cerr << "Warning: invalid job '" << names[i] << "'" << std::endl;
+			dir.fail(names[i]);
+			continue;
+		}
+
+		util::hr_timer timer;
+		timer.start();
+		{
+			Checkpoint journal(ctx.e->rules(), ctx.obj, constraints);
+			if (!journal.open(dir.partial_result(names[i])))
+			{
+				std::cerr << "Warning: cannot write the result of job '"
+					<< names[i] << "'" << std::endl;
+				dir.fail(names[i]);
+				continue;
+			}
+			solve_job(ctx, filter, all, constraints, Codeword::unpack(guess),
+				Feedback(response), &journal);
+		}
+		if (!dir.complete(names[i]))
+		{
+			std::cerr << "Warning: cannot complete job '" << names[i] << "'"
+				<< std::endl;
+			dir.fail(names[i]);
+			continue;
+		}
+		++count;
+
+		if (verbose)
+		{
+			std::cerr << "Solved job " << names[i] << " in "
+				<< std::setprecision(1) << std::fixed << timer.stop() << " s"
+				<< std::endl;
+		}
+	}
+	return count;
+}
+
+/**
+ * Distributes a search through a job directory. Each non-perfect cell of
+ * each canonical initial guess is posted as a job, unless the directory
+ * already holds the jobs of the same search (e.g. if the search is being
+ * restarted, in which case the jobs claimed by the workers of the earlier
+ * run, or failed, are requeued). The jobs are then solved together with
+ * any worker processes serving the directory, and their results are
+ * loaded into @c checkpoint.
+ *
+ * The results are only a shortcut: the search solves the subproblems of
+ * the jobs that failed, or that no worker completed in time, by itself.
+ *
+ * @returns @c true if the directory is used, @c false if it cannot be.
+ */
+static bool run_distributed(
+	const SearchContext &ctx,
+	const CompositeEquivalenceFilter &filter,
+	const CodewordList &all,
+	const CodewordList &initial,
+	StrategyConstraints constraints,
+	const OptimalSearchOptions &options,
+	Checkpoint &checkpoint)
+{
+	const Engine *e = ctx.e;
+	const Feedback perfect = Feedback::perfectValue(e->rules());
+	const std::string header = checkpoint.header();
+	JobDirectory dir(options.jobs);
+
+	std::vector<std::string> names;
+	if (dir.read_index(header, names))
+	{
+		size_t count = dir.requeue(names);
+		if (count > 0)
+		{
+			std::cerr << "Requeued " << count << " jobs left unfinished in '"
+				<< options.jobs << "' by an earlier run" << std::endl;
+		}
+	}
+	else
+	{
+		if (dir.has_index())
+		{
+			std::cerr << "Warning: job directory '" << options.jobs
+				<< "' belongs to a different search; not distributing it"
+				<< std::endl;
+			return false;
+		}
+		for (size_t i = 0; i < initial.size(); ++i)
+		{
+			CodewordList partitioned(all);
+			CodewordPartition cells = e->partition(partitioned, initial[i]);
+			for (size_t j = 0; j < cells.size(); ++j)
+			{
+				if (cells[j].empty() || Feedback(j) == perfect)
+					continue;
+
+				std::ostringstream name, description;
+				name << "g" << i << "-r" << j;
+				description << std::hex << initial[i].pack() << std::dec
+					<< ' ' << j;
+				if (!dir.post(name.str(), description.str()))
+				{
+					std::cerr << "Warning: cannot post jobs to directory '"
+						<< options.jobs << "'" << std::endl;
+					return false;
+				}
+				names.push_back(name.str());
+			}
+		}
+		if (!dir.write_index(header, names))
+		{
+			std::cerr << "Warning: cannot write the index of job directory '"
+				<< options.jobs << "'" << std::endl;
+			return false;
+		}
+	}
+
+	// Work on the jobs like any other worker, then wait for the jobs
+	// claimed by the other workers to complete. While waiting, claim the
+	// jobs that the other workers put back in the queue.
+	std::vector<std::string> pending(names);
+	std::chrono::steady_clock::time_point last_change =
+		std::chrono::steady_clock::now();
+	bool waiting = false;
+	while (true)
+	{
+		if (run_jobs(ctx, filter, all, constraints, dir, pending, options.progress) > 0)
+			waiting = false;
+
+		std::vector<std::string> unfinished;
+		for (size_t i = 0; i < pending.size(); ++i)
+		{
+			if (dir.is_complete(pending[i]))
+			{
+				if (!checkpoint.load(dir.result(pending[i])))
+				{
+					std::cerr << "Warning: cannot load the result of job '"
+						<< pending[i] << "'" << std::endl;
+				}
+			}
+			else if (dir.is_failed(pending[i]))
+			{
+				std::cerr << "Warning: job '" << pending[i] << "' failed; "
+					"solving its subproblem in this process" << std::endl;
+			}
+			else
+			{
+				unfinished.push_back(pending[i]);
+			}
+		}
+		if (unfinished.size() < pending.size())
+			last_change = std::chrono::steady_clock::now();
+		pending.swap(unfinished);
+		if (pending.empty())
+			break;
+
+		if (std::chrono::steady_clock::now() - last_change >=
+			std::chrono::seconds(options.job_timeout))
+		{
+			std::cerr << "Warning: no job completed in " << options.job_timeout
+				<< " s; solving the subproblems of " << pending.size()
+				<< " jobs in this process" << std::endl;
+			break;
+		}
+		if (!waiting && options.progress)
+		{
+			std::cerr << "Waiting for " << pending.size()
+				<< " jobs to be solved by other workers" << std::endl;
+		}
+		waiting = true;
+		std::this_thread::sleep_for(std::chrono::seconds(JOB_POLL_INTERVAL));
+	}
+	return true;
+}
+
+// Creates the response-dependent equivalence filter of a search, which is
+// the color equivalence filter, chained with the automorphism filter if
+// requested. The automorphism filter is not used with the possibility-only
+// constraint, because the candidates of a cell are then drawn from the
+// secrets before the last guess, which an automorphism of the cell need
+// not map onto themselves.
+static EquivalenceFilter* create_response_filter(const Engine *e,
+	StrategyConstraints c, const OptimalSearchOptions &options)
+{
+	std::unique_ptr<EquivalenceFilter> color(CreateColorEquivalenceFilter(e));
+	if (!options.automorphisms || c.pos_only)
+		return color.release();
+
+	std::unique_ptr<EquivalenceFilter> automorphism(
+		CreateAutomorphismEquivalenceFilter(e));
+	return new CompositeEquivalenceFilter(color.get(), automorphism.get());
+}
+
+bool Mastermind::solve_optimal_jobs(
+	const Engine *e,
+	StrategyObjective obj,
+	StrategyConstraints constraints,
+	const OptimalSearchOptions &options,
+	size_t &count)
+{
+	count = 0;
+
+	CodewordList all = e->generateCodewords();
+	CompositeEquivalenceFilter filter(
+		CreateConstraintEquivalenceFilter(e),
+		create_response_filter(e, constraints, options));
+
+	// Wait for the jobs to be posted if the worker is started before the
+	// search that posts them.
+	Checkpoint checkpoint(e->rules(), obj, constraints);
+	JobDirectory dir(options.jobs);
+	for (unsigned int waited = 0; !dir.has_index(); waited += JOB_POLL_INTERVAL)
+	{
+		if (waited >= options.job_timeout)
+		{
+			std::cerr << "Error: no jobs posted to directory '" << options.jobs
+				<< "' in " << options.job_timeout << " s" << std::endl;
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::seconds(JOB_POLL_INTERVAL));
+	}
+
+	std::vector<std::string> names;
+	if (!dir.read_index(checkpoint.header(), names))
+	{
+		std::cerr << "Error: job directory '" << options.jobs
+			<< "' belongs to a different search" << std::endl;
+		return false;
+	}
+
+	LowerBoundEstimator estimator(e, make_heuristic(e, &filter, obj, options));
+
+	std::unique_ptr<TranspositionTable> tt;
+	if (options.tt_size > 0)
+		tt.reset(new TranspositionTable(options.tt_size));
+
+	// The tablebase is only read by a worker, so that multiple workers
+	// do not overwrite the same file.
+	std::unique_ptr<Tablebase> tb;
+	if (!options.tablebase.empty() && !constraints.pos_only)
+	{
+		tb.reset(new Tablebase(e->rules(), obj, options.tablebase_size));
+		tb->load(options.tablebase);
+	}
+
+	UpperBoundMap upper_bounds;
+	if (options.bootstrap)
+		collect_upper_bounds(*options.bootstrap, obj, upper_bounds);
+
+	SearchContext ctx;
+	ctx.e = e;
+	ctx.estimator = &estimator;
+	ctx.obj = obj;
+	ctx.tt = tt.get();
+	ctx.tb = tb.get();
+	ctx.checkpoint = NULL;
+	ctx.progress = NULL;
+	ctx.stats = options.stats;
+	ctx.history = options.history;
+	ctx.mtd = options.mtd;
+	ctx.upper_bounds = options.bootstrap ? &upper_bounds : NULL;
+
+	count = run_jobs(ctx, filter, all, constraints, dir, names, options.progress);
+	return true;
+}
+
+/**
+ * Appends a copy of the strategy below node @c from to node @c to, with
+ * the guesses permuted by @c perm. The responses are unchanged, since a
+ * permutation preserves the response between any pair of codewords.
+ */
+static void copy_permuted_strategy(
+	StrategyTree &tree,
+	StrategyTree::const_iterator from,
+	StrategyTree::iterator to,
+	const CodewordPermutation &perm)
+{
+	// Copy the nodes first, as the tree grows while they are inserted.
+	std::vector<std::pair<int,StrategyNode>> branch;
+	auto nodes = tree.traverse(from);
+	for (auto it = nodes.begin(); it != nodes.end(); ++it)
+		branch.push_back(std::make_pair(it.depth() - from.depth(), *it));
+
+	// Insert the nodes in preorder, keeping the last node inserted at
+	// each depth as the parent of the next deeper node.
+	std::vector<StrategyTree::iterator> parents(1, to);
+	for (size_t i = 1; i < branch.size(); ++i)
+	{
+		int d = branch[i].first;
+		const StrategyNode &node = branch[i].second;
+		parents.resize(d);
+		parents.push_back(tree.insert_child(parents[d-1],
+			StrategyNode(perm.permute(node.guess()), node.response())));
+	}
+}
+
+/**
+ * Appends an optimal strategy for the given set of remaining secrets to
+ * a tree, after <code>fill_strategy_tree()</code> has found its cost.
+ *
+ * The function walks down the optimal strategy in the same way as the
+ * search, and takes the optimal guess of each state from the record of
+ * the search: the transposition table, the checkpoint journal, or the
+ * tablebase. A state whose guess is not recorded, such as a state solved
+ * in closed form, is given to the endgame solver, or else solved again.
+ * Either way the guess is the one the search would find, so the tree does
+ * not depend on what the records still hold. Only the states on the optimal strategy are visited, so this is cheap
+ * compared to the search.
+ */
+static void replay_strategy_tree(
+	const SearchContext &ctx,
+	CodewordRange secrets,            // remaining secrets; not modified
+	TranspositionTable::key_type hash,// hash key of the secrets
+	CodewordRange candidates,         // canonical guesses
+	const EquivalenceFilter *filter1, // response-independent equivalence filter
+	const EquivalenceFilter *filter2, // response-dependent equivalence filter
+	const int depth,                  // depth of the current state; root=0
+	StrategyConstraints c,            // constraints
+	Codeword guess,                   // optimal guess, or empty if unknown
+	StrategyTree &tree,               // tree to store the strategy
+	StrategyTree::iterator where      // iterator to the current state
+	)
+{
+	const Engine *e = ctx.e;
+	const StrategyObjective obj = ctx.obj;
+	const Feedback perfect = Feedback::perfectValue(e->rules());
+	const unsigned int nsecrets = (int)secrets.size();
+
+	if (nsecrets == 1)
+	{
+		tree.insert_child(where, StrategyNode(secrets[0], perfect));
+		return;
+	}
+
+	// Look up the optimal guess in the same order as the search does.
+	if (guess.IsEmpty())
+	{
+		TranspositionTable::key_type key = TranspositionTable::combine(hash,
+			TranspositionTable::hash_sequence(candidates), c.max_depth);
+		TranspositionTable::Entry entry;
+		Checkpoint::Entry saved;
+		StrategyCost cost;
+		if (ctx.tt && ctx.tt->lookup(key, nsecrets, entry) &&
+			entry.type == TranspositionTable::Exact)
+			guess = Codeword::unpack(entry.guess);
+		else if (ctx.checkpoint && ctx.checkpoint->lookup(key, saved) && saved.exact)
+			guess = Codeword::unpack(saved.guess);
+		else if (ctx.tb && ctx.tb->covers(nsecrets) && c.max_depth >= nsecrets)
+			ctx.tb->lookup(secrets, cost, guess);
+	}
+
+#if ENDGAME_SOLVER
+	// A state that the search may have solved in closed form has no
+	// recorded guess; the endgame solver finds the same guess as the search.
+	if (guess.IsEmpty() && obj == MinSteps && c.max_depth >= nsecrets &&
+		nsecrets <= (size_t)(ENDGAME_SIZE_FACTOR *
+		(ctx.estimator->heuristic().branching_factor() + 1)))
+	{
+		const Heuristics::MinimizeLowerBound &h = ctx.estimator->heuristic();
+		solve_endgame(e, secrets, candidates, h, h.branching_factor(),
+			StrategyCost(UNLIMITED_STEPS, 100, 0), &guess);
+	}
+#endif
+
+	// Solve the state again if its guess is no longer recorded.
+	if (guess.IsEmpty())
+	{
+		UPDATE_CALL_COUNTER("OptimalReplay_Research", (int)nsecrets);
+		fill_strategy_tree(ctx, secrets, hash, candidates, filter1, filter2,
+			depth, c, StrategyCost(UNLIMITED_STEPS, 100, 0), NULL, guess);
+		assert(!guess.IsEmpty());
+	}
+	--c.max_depth;
+
+	// Partition the secrets and visit the cells in the same order as
+	// fill_strategy_tree_with_guess(), so that the children of each node
+	// are in the same order as they would be if the tree had been built
+	// during the search.
+	CodewordList partitioned(secrets.begin(), secrets.end());
+	CodewordPartition cells = e->partition(partitioned, guess);
+	std::array<int,Feedback::MaxOutcomes> responses;
+	size_t nresponses = order_cells(cells, responses);
+
+	CodewordList pre_filtered;
+	std::unique_ptr<EquivalenceFilter> pre_filter(filter1->clone());
+	pre_filter->add_constraint(guess, Feedback(), e->universe());
+	std::vector<size_t> recursed; // cells solved by recursion
+	std::vector<StrategyTree::iterator> nodes(nresponses);
+	CellHashes cell_hashes(hash, cells, responses, nresponses);
+
+	for (size_t j = 0; j < nresponses; ++j)
+	{
+		Feedback feedback = Feedback(responses[j]);
+		CodewordRange cell = cells[feedback.value()];
+		StrategyTree::iterator it = tree.insert_child(where, StrategyNode(guess, feedback));
+		nodes[j] = it;
+		if (feedback == perfect)
+			continue;
+		if (!!fill_obviously_optimal_strategy(e, cell, obj, c, tree, it))
+			continue;
+
+		// Copy the strategy of a symmetric cell, with the guesses permuted.
+		CodewordPermutation perm;
+		size_t k = find_symmetric_cell(filter1, cells, responses, recursed,
+			cell, perm);
+		if (k != (size_t)-1)
+		{
+			copy_permuted_strategy(tree, nodes[k], it, perm);
+			continue;
+		}
+		recursed.push_back(j);
+
+		if (pre_filtered.empty())
+		{
+			if (c.pos_only)
+				pre_filtered = pre_filter->get_canonical_guesses(partitioned);
+			else
+				pre_filtered = pre_filter->generate_canonical_guesses(e);
+		}
+		std::unique_ptr<EquivalenceFilter> new_filter(filter2->clone());
+		new_filter->add_constraint(guess, feedback, cell);
+		CodewordList canonical = new_filter->get_canonical_guesses(pre_filtered);
+
+		replay_strategy_tree(ctx, cell, cell_hashes[j],
+			canonical, pre_filter.get(), new_filter.get(), depth + 1, c,
+			Codeword(), tree, it);
+	}
+}
+
+StrategyTree Mastermind::build_optimal_strategy_tree(
+	const Engine *e,
+	StrategyObjective obj,
+	StrategyConstraints constraints,
+	const OptimalSearchOptions &options)
+{
+	CodewordList all = e->generateCodewords();
+
+	// Creates a composite equivalence filter by chaining a
+	// response-indepedent filter with a response-dependent filter.
+	CompositeEquivalenceFilter filter(
+		CreateConstraintEquivalenceFilter(e),
+		create_response_filter(e, constraints, options));
+
+	// Create a strategy tree.
+	StrategyTree tree(e->rules());
+
+	// Set options.
+	// StrategyObjective obj = min_depth ? MinDepth : MinSteps;
+	//StrategyConstraints c;
+	//c.max_depth = (unsigned char)std::min(100, max_depth);
+	//c.find_last = false;
+
+	// Create a cost lower-bound estimator.
+	LowerBoundEstimator estimator(e, make_heuristic(e, &filter, obj, options));
 
 	// Filter canonical candidates for the initial guess.
-	CodewordList initial = filter.get_canonical_guesses(e->universe());
+	CodewordList initial = filter.generate_canonical_guesses(e);
+
+	// Create a transposition table to memoize solved subproblems.
+	std::unique_ptr<TranspositionTable> tt;
+	if (options.tt_size > 0)
+		tt.reset(new TranspositionTable(options.tt_size));
+
+	SearchContext ctx;
+	ctx.e = e;
+	ctx.estimator = &estimator;
+	ctx.obj = obj;
+	ctx.tt = tt.get();
+
+	// Load the endgame tablebase if one is specified. The tablebase is
+	// not used with the possibility-only constraint, because the guesses
+	// allowed for a set of secrets then depend on where the set occurs.
+	std::unique_ptr<Tablebase> tb;
+	if (!options.tablebase.empty() && !constraints.pos_only)
+	{
+		tb.reset(new Tablebase(e->rules(), obj, options.tablebase_size));
+		if (!tb->load(options.tablebase) && std::ifstream(options.tablebase.c_str()))
+		{
+			std::cerr << "Warning: cannot load tablebase from '"
+				<< options.tablebase << "'; starting with an empty one"
+				<< std::endl;
+		}
+	}
+	ctx.tb = tb.get();
+
+	// Open the checkpoint file, and resume from the subproblems journaled
+	// in it by an earlier run of the same search.
+	std::unique_ptr<Checkpoint> checkpoint;
+	if (!options.checkpoint.empty())
+	{
+		checkpoint.reset(new Checkpoint(e->rules(), obj, constraints));
+		if (!checkpoint->open(options.checkpoint))
+		{
+			std::cerr << "Warning: cannot use checkpoint file '"
+				<< options.checkpoint << "'; it may belong to a different search"
+				<< std::endl;
+			checkpoint.reset();
+		}
+		else if (checkpoint->size() > 0)
+		{
+			std::cerr << "Resuming from " << checkpoint->size()
+				<< " subproblems in checkpoint file '" << options.checkpoint
+				<< "'" << std::endl;
+		}
+	}
+	ctx.checkpoint = checkpoint.get();
+
+	// Collect the costs of the bootstrap strategy to seed the thresholds.
+	UpperBoundMap upper_bounds;
+	if (options.bootstrap)
+		collect_upper_bounds(*options.bootstrap, obj, upper_bounds);
+	ctx.upper_bounds = options.bootstrap ? &upper_bounds : NULL;
+
+	// If the search is distributed, solve the subproblems after the
+	// initial guess as jobs, together with any worker processes, and
+	// merge their results into the checkpoint. The search below then
+	// finds the optimal cost of each subproblem in the checkpoint.
+	if (!options.jobs.empty())
+	{
+		if (!checkpoint)
+			checkpoint.reset(new Checkpoint(e->rules(), obj, constraints));
+		if (run_distributed(ctx, filter, all, initial, constraints,
+			options, *checkpoint))
+		{
+			ctx.checkpoint = checkpoint.get();
+		}
+	}
+
+	// Report the progress of the search if requested.
+	std::unique_ptr<ProgressReport> progress;
+	if (options.progress)
+	{
+		progress.reset(new ProgressReport());
+		progress->start(initial);
+	}
+	ctx.progress = progress.get();
+	ctx.stats = options.stats;
+	ctx.history = options.history;
+	ctx.mtd = options.mtd;
+
+	TranspositionTable::key_type hash = TranspositionTable::hash_set(all);
 
 	// Recursively find an optimal strategy.
-	StrategyCost threshold(1000000, 100, 0);
-	/* int best = */ fill_strategy_tree(e, all, initial, 
-		filter.first(), filter.second(), estimator,
-		0, obj, constraints, threshold, tree, tree.root());
+	Codeword guess;
+	/* StrategyCost best = */ solve_state(ctx, all, hash, initial,
+		filter.first(), filter.second(), 0, constraints, guess);
 	// std::cout << "OPTIMAL: " << best << std::endl;
+
+	if (progress)
+		progress->finish();
+
+	// The search only computes the costs; build the strategy tree by
+	// replaying the optimal guess of each state.
+	if (!guess.IsEmpty())
+	{
+		replay_strategy_tree(ctx, all, hash, initial,
+			filter.first(), filter.second(),
+			0, constraints, guess, tree, tree.root());
+	}
+
+	// Save the tablebase, including the sets solved by this search.
+	if (tb && !tb->save(options.tablebase))
+	{
+		std::cerr << "Warning: cannot save tablebase to '"
+			<< options.tablebase << "'" << std::endl;
+	}
 	return tree;
 }
 
+StrategyTree build_optimal_strategy_tree(
+	const Engine *e, StrategyObjective obj, StrategyConstraints constraints)
+{
+	return Mastermind::build_optimal_strategy_tree(e, obj, constraints,
+		OptimalSearchOptions());
+}
+
 // Call statistics for optimal Mastermind (p4c6r) that finds the FIRST:
 // Total # of calls : 5832
 // Total # of ops   : 59209
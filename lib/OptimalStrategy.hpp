@@ -4,25 +4,41 @@
 #include <cassert>
 #include <vector>
 #include <numeric>
+#include <string>
+#include <algorithm>
 
 #include "Engine.hpp"
+#include "Equivalence.hpp"
 #include "Strategy.hpp"
+#include "StrategyTree.hpp"
+#include "SearchStatistics.hpp"
 #include "util/call_counter.hpp"
 #include "util/intrinsic.hpp"
 
 namespace Mastermind {
 
+namespace Heuristics {
+
 /**
- * Define MINIMIZE_WORSTCASE_COUNT = 1 to include code to minimize the 
- * number of secrets that are revealed by the maximum number of steps.
- * This will produce a better-looking result, but will take more time
- * to run.
+ * Computes an upper bound of the number of secrets that can be revealed
+ * within @c n guesses, for <code>n = 0, 1, 2, ...</code>, until the bound
+ * covers all secrets. This bound also applies to any state of the game,
+ * because a strategy that starts from that state can be replayed from
+ * the initial state.
+ *
+ * The bound for @c n guesses is found by making each canonical initial
+ * guess and adding up the bound of each cell, which is the cell size
+ * capped by the bound for <code>n-1</code> guesses. The cells are
+ * expanded this way up to @c expand_levels levels deep; the more levels,
+ * the tighter (and slower) the bound. The cells of the initial guesses
+ * are processed in parallel if OpenMP is enabled.
+ *
+ * @ingroup Optimal
  */
-#ifndef MINIMIZE_WORSTCASE_COUNT
-#define MINIMIZE_WORSTCASE_COUNT 0
-#endif
-
-namespace Heuristics {
+std::vector<int> max_breakable_within(
+	const Engine *e,
+	const EquivalenceFilter *filter,
+	int expand_levels);
 
 /**
  * Special-purpose heuristic used by an optimal strategy to score a
@@ -41,7 +57,9 @@ public:
 
 	/// Returns a simple estimate of minimum total number of steps
 	/// required to reveal @c n secrets given a branching factor of @c b,
-	/// including the initial guess.
+	/// including the initial guess. The depth and worst count of the
+	/// estimate are those of revealing as many secrets as possible at
+	/// each level.
 	static score_t simple_estimate(
 		int n, // Number of remaining secrets
 		int b  // Branching factor: number of distinct non-perfect feedbacks
@@ -52,10 +70,7 @@ public:
 		{
 			cost.steps += remaining;
 			cost.depth++;
-#if MINIMIZE_WORSTCASE_COUNT
-			cost.worst2 = cost.worst1;
-			cost.worst1 = std::min(count, remaining);
-#endif
+			cost.worst = (unsigned short)std::min(count, remaining);
 			remaining -= count;
 			count *= b;
 		}
@@ -66,22 +81,59 @@ private:
 
 	//Engine &e;
 	std::vector<score_t> _cache;
+	StrategyObjective _obj;
+	int _b; // maximum branching factor of the game
 
 public:
 
-	/// Constructs the heuristic.
-	MinimizeLowerBound(const Engine *engine)
-		: /* e(engine), */ _cache(engine->rules().size()+1)
+	/// Constructs the heuristic. The worst count of the score is only
+	/// computed if the objective @c obj takes it into account.
+	MinimizeLowerBound(const Engine *engine, StrategyObjective obj = MinSteps)
+		: /* e(engine), */ _cache(engine->rules().size()+1), _obj(obj)
 	{
 		// Build a cache of simple estimates.
 		int p = engine->rules().pegs();
-		int b = p*(p+3)/2-1;
+		int b = _b = p*(p+3)/2-1;
 		for (size_t n = 0; n < _cache.size(); ++n)
 		{
 			_cache[n] = simple_estimate((int)n, b);
 		}
 	}
 
+	/// Constructs the heuristic from an upper bound of the number of
+	/// secrets that can be revealed within a given number of guesses,
+	/// as computed by <code>max_breakable_within()</code>. If at most
+	/// <code>f[j]</code> secrets can be revealed within @c j guesses,
+	/// then at least <code>n-f[j]</code> of @c n secrets need more than
+	/// @c j guesses, which adds up to a lower bound of the total steps.
+	MinimizeLowerBound(const Engine *engine, const std::vector<int> &f,
+		StrategyObjective obj = MinSteps)
+		: /* e(engine), */ _cache(engine->rules().size()+1), _obj(obj)
+	{
+		int p = engine->rules().pegs();
+		int b = _b = p*(p+3)/2-1;
+		const int total = (int)_cache.size() - 1;
+		std::vector<int> bound;
+		int geometric = 0, count = 1;
+		for (int j = 0; ; ++j)
+		{
+			bound.push_back(j < (int)f.size() ? std::min(f[j], geometric) : geometric);
+			if (bound.back() >= total)
+				break;
+			geometric = std::min(geometric + count, total);
+			count = std::min(count * b, total);
+		}
+		for (size_t n = 0; n < _cache.size(); ++n)
+		{
+			score_t cost;
+			while (bound[cost.depth] < (int)n)
+				cost.steps += (unsigned int)(n - bound[cost.depth++]);
+			if (cost.depth > 0)
+				cost.worst = (unsigned short)(n - bound[cost.depth-1]);
+			_cache[n] = cost;
+		}
+	}
+
 	/// Returns the name of the heuristic.
 	std::string name() const { return "Min-LB"; }
 
@@ -94,12 +146,47 @@ public:
 		return _cache[n];
 	}
 
-	/// Computes the heuristic score. The score consist of two parts:
+	/// Returns the maximum branching factor of the game, i.e. the number
+	/// of distinct non-perfect feedbacks.
+	int branching_factor() const { return _b; }
+
+	/// Returns a lower bound of the total number of steps required to
+	/// reveal @c n secrets, including the initial guess, if no guess can
+	/// split them into more than @c b non-perfect cells. This is the
+	/// tighter of <code>simple_estimate(n)</code> and the simple estimate
+	/// with branching factor @c b.
+	score_t estimate(int n, int b) const
+	{
+		score_t cost = simple_estimate(n);
+		if (b >= _b)
+			return cost;
+
+		score_t tight = simple_estimate(n, std::max(b, 1));
+		if (tight.depth > cost.depth ||
+			(tight.depth == cost.depth && tight.worst > cost.worst))
+		{
+			cost.depth = tight.depth;
+			cost.worst = tight.worst;
+		}
+		cost.steps = std::max(cost.steps, tight.steps);
+		return cost;
+	}
+
+	/// Computes the heuristic score. The score consist of three parts:
 	/// - The total number of steps needed to reveal all secrets, excluding
 	///   the initial guess
 	/// - The maximum depth (i.e. number of extra guesses) needed to reveal
 	///   every secret.
+	/// - The number of secrets revealed at the maximum depth, if the
+	///   objective is MinWorst; zero otherwise.
 	score_t compute(const FeedbackFrequencyTable &freq) const
+	{
+		return compute(freq, _b);
+	}
+
+	/// Computes the heuristic score as above, given that no guess can
+	/// split any of the cells into more than @c b non-perfect cells.
+	score_t compute(const FeedbackFrequencyTable &freq, int b) const
 	{
 		// Note: we make the critical assumptions that:
 		// - Feedback::size()-1 is the perfect feedback, and
@@ -110,12 +197,6 @@ public:
 
 		// In addition, in order to find the maximum depth of all paritions,
 		// we use a bitset for quicker operation.
-		// Note: We could further save two instructions by storing tmp.depth
-		// as a bit-mask directly. However, this has two drawbacks:
-		// 1) it obscures the source code;
-		// 2) it makes it harder to implement 'worst' optimization in the
-		//    future.
-		// Therefore, we will not use that approach for now.
 		unsigned int depth_bitset = 0;
 		int steps = 0;
 		size_t m = freq.size() - 2;
@@ -125,34 +206,31 @@ public:
 			if (freq[j] == 0) 
 				continue;
 #endif
-			score_t tmp = simple_estimate(freq[j]);
+			score_t tmp = estimate(freq[j], b);
 			steps += tmp.steps;
-#if MINIMIZE_WORSTCASE_COUNT
-			if (tmp.depth > lb.depth)
-			{
-				lb.depth = tmp.depth;
-				lb.worst1 = tmp.worst1;
-				lb.worst2 = tmp.worst2;
-			}
-			else if (tmp.depth == lb.depth)
-			{
-				lb.worst1 += tmp.worst1;
-				lb.worst2 += tmp.worst2;
-			}
-			else if (tmp.depth == lb.depth - 1)
-			{
-				lb.worst2 += tmp.worst1;
-			}
-#else
 			//lb.depth = std::max(lb.depth, tmp.depth);
 			depth_bitset |= (1 << tmp.depth);
-#endif
 		}
 		score_t lb;
 		lb.steps = steps;
 		lb.depth = (unsigned short)(depth_bitset == 0 ? 
 			0 : util::intrinsic::bit_scan_reverse(depth_bitset));
 
+		// Count the secrets revealed at the maximum depth in a second
+		// pass, which keeps the tight loop above free of it when the
+		// worst count does not matter.
+		if (_obj >= MinWorst)
+		{
+			unsigned int worst = 0;
+			for (size_t j = 0; j < m; ++j)
+			{
+				score_t tmp = estimate(freq[j], b);
+				if (tmp.depth == lb.depth)
+					worst += tmp.worst;
+			}
+			lb.worst = (unsigned short)worst;
+		}
+
 		UPDATE_CALL_COUNTER("ComputeLowerBound_Steps", lb.steps);
 		UPDATE_CALL_COUNTER("ComputeLowerBound_Depth", lb.depth);
 		return lb;
@@ -232,6 +310,103 @@ public:
 		CodewordConstRange candidates) const;
 };
 
+/// Options that control the search for an optimal strategy tree.
+/// @ingroup Optimal
+struct OptimalSearchOptions
+{
+	/// Number of entries in the transposition table used to memoize
+	/// solved subproblems. Zero disables the table.
+	size_t tt_size;
+
+	/// Path of the endgame tablebase file, which is loaded before the
+	/// search and saved after it. Empty if no tablebase is used.
+	std::string tablebase;
+
+	/// Maximum number of secrets in a set stored in the tablebase.
+	size_t tablebase_size;
+
+	/// Number of levels to expand when computing the counting lower
+	/// bound (see <code>Heuristics::max_breakable_within()</code>).
+	/// Zero uses the simple branching-factor bound only.
+	int counting_bound;
+
+	/// Path of the checkpoint file, which journals the subproblems solved
+	/// near the root of the search so that an interrupted search can be
+	/// resumed from it. Empty if no checkpoint is written.
+	std::string checkpoint;
+
+	/// Whether to report the progress of the search to the standard
+	/// error stream.
+	bool progress;
+
+	/// Strategy tree of a known (e.g. heuristic) strategy that satisfies
+	/// the same constraints. Its cost at each state bounds the optimal
+	/// cost of the same set of secrets from above, and is used to seed
+	/// the pruning threshold of that subproblem. NULL if not used.
+	const StrategyTree *bootstrap;
+
+	/// Path of an existing directory through which the search is split
+	/// into jobs, one for each cell of each canonical initial guess. The
+	/// jobs are solved by this process together with any worker processes
+	/// serving the same directory (see <code>solve_optimal_jobs()</code>),
+	/// on one machine or on a shared filesystem. Empty if the search runs
+	/// in a single process.
+	std::string jobs;
+
+	/// Number of seconds to wait for the jobs posted to the job directory.
+	/// A search stops waiting for the jobs claimed by other workers if
+	/// none of them completes for that long, and solves their subproblems
+	/// itself; a worker gives up if no job is posted for that long.
+	unsigned int job_timeout;
+
+	/// Collects per-depth statistics of the search if not NULL.
+	SearchStatistics *stats;
+
+	/// Whether to explore the candidates of equal lower bound in the order
+	/// of how often they were the optimal guess of related subproblems
+	/// (the history heuristic). This does not change the strategy found.
+	bool history;
+
+	/// Whether to find the optimal cost by a series of searches with
+	/// narrow thresholds above the lower bound, instead of a single search
+	/// with no threshold. This does not change the strategy found.
+	bool mtd;
+
+	/// Whether to also filter the candidates of each state by the
+	/// automorphisms of its remaining secrets (see
+	/// <code>CreateAutomorphismEquivalenceFilter()</code>). This may change
+	/// which of several optimal guesses is chosen, but not the cost. It is
+	/// ignored with the possibility-only constraint.
+	bool automorphisms;
+
+	OptimalSearchOptions()
+		: tt_size(1 << 20), tablebase_size(8), counting_bound(0),
+		progress(false), bootstrap(NULL), job_timeout(600), stats(NULL),
+		history(false), mtd(false), automorphisms(false) { }
+};
+
+/// Builds an optimal strategy tree.
+/// @ingroup Optimal
+StrategyTree build_optimal_strategy_tree(
+	const Engine *e,
+	StrategyObjective obj,
+	StrategyConstraints constraints,
+	const OptimalSearchOptions &options);
+
+/// Solves the jobs of an optimal strategy search that are waiting in the
+/// job directory <code>options.jobs</code>, until none is left. The search
+/// parameters must be the same as those of the search that posted the
+/// jobs. Stores the number of jobs solved in @c count. Returns @c false if
+/// no jobs are posted within <code>options.job_timeout</code> seconds, or
+/// if they belong to a different search.
+/// @ingroup Optimal
+bool solve_optimal_jobs(
+	const Engine *e,
+	StrategyObjective obj,
+	StrategyConstraints constraints,
+	const OptimalSearchOptions &options,
+	size_t &count);
+
 } // namespace Mastermind
 
 #endif // MASTERMIND_OPTIMAL_STRATEGY_HPP
@@ -34,24 +34,22 @@ public:
 		std::iota(peg + 0, peg + MM_MAX_PEGS, (int8_t)0);
 	}
 
-#if 0
 	/// Returns the inverse of the permutation.
 	CodewordPermutation inverse() const
 	{
-		CodewordPermutation ret(_rules);
-		for (int i = 0; i < _rules.pegs(); ++i)
+		CodewordPermutation ret;
+		for (int i = 0; i < MM_MAX_PEGS; ++i)
 		{
 			if (peg[i] >= 0)
-				ret.peg[peg[i]] = i;
+				ret.peg[(int)peg[i]] = (int8_t)i;
 		}
-		for (int i = 0; i < _rules.colors(); ++i)
+		for (int i = 0; i < MM_MAX_COLORS; ++i)
 		{
 			if (color[i] >= 0)
-				ret.color[color[i]] = i;
+				ret.color[(int)color[i]] = (int8_t)i;
 		}
 		return ret;
 	}
-#endif
 
 	/// Permutes the pegs and colors in a codeword.
 	Codeword permute(const Codeword &w) const
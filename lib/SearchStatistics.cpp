@@ -0,0 +1,52 @@
+#include <iomanip>
+
+#include "SearchStatistics.hpp"
+
+namespace Mastermind {
+
+// Returns a / b, or zero if b is zero.
+static double ratio(unsigned long long a, unsigned long long b)
+{
+	return (b == 0)? 0.0 : (double)a / (double)b;
+}
+
+void SearchStatistics::write_json(std::ostream &os) const
+{
+	int last = MaxDepth;
+	while (last >= 0 && _depths[last].nodes == 0 &&
+		_depths[last].obvious == 0 && _depths[last].endgame == 0)
+		--last;
+
+	std::ios_base::fmtflags flags = os.flags();
+	std::streamsize precision = os.precision();
+	os << std::fixed;
+
+	os << "{" << std::endl << "  \"depths\": [";
+	for (int d = 0; d <= last; ++d)
+	{
+		const DepthStatistics &s = _depths[d];
+		os << (d > 0 ? "," : "") << std::endl
+			<< "    { \"depth\": " << d
+			<< ", \"nodes\": " << s.nodes
+			<< ", \"solved\": " << s.solved
+			<< ", \"candidates\": " << s.candidates
+			<< ", \"pruned_bound\": " << s.pruned_bound
+			<< ", \"explored\": " << s.explored
+			<< ", \"pruned_threshold\": " << s.pruned_threshold
+			<< ", \"first_best\": " << s.first_best
+			<< ", \"first_best_rate\": " << std::setprecision(4)
+			<< ratio(s.first_best, s.solved)
+			<< ", \"avg_bound_gap\": " << std::setprecision(4)
+			<< ratio(s.bound_gap, s.solved)
+			<< ", \"obvious\": " << s.obvious
+			<< ", \"endgame\": " << s.endgame
+			<< ", \"seconds\": " << std::setprecision(6) << s.seconds
+			<< " }";
+	}
+	os << std::endl << "  ]" << std::endl << "}" << std::endl;
+
+	os.flags(flags);
+	os.precision(precision);
+}
+
+} // namespace Mastermind
@@ -0,0 +1,115 @@
+#ifndef MASTERMIND_SEARCH_STATISTICS_HPP
+#define MASTERMIND_SEARCH_STATISTICS_HPP
+
+#include <iostream>
+#include <array>
+
+namespace Mastermind {
+
+/**
+ * Statistics of the nodes expanded at one depth of an optimal strategy
+ * search.
+ *
+ * @ingroup Optimal
+ */
+struct DepthStatistics
+{
+	/// Number of nodes whose candidate guesses were scored.
+	unsigned long long nodes;
+
+	/// Number of nodes for which a strategy below the threshold was found.
+	unsigned long long solved;
+
+	/// Number of candidate guesses scored.
+	unsigned long long candidates;
+
+	/// Number of candidates pruned because their lower bound reaches the
+	/// threshold, without partitioning the secrets.
+	unsigned long long pruned_bound;
+
+	/// Number of candidates explored.
+	unsigned long long explored;
+
+	/// Number of candidates explored and then cut off by the threshold.
+	unsigned long long pruned_threshold;
+
+	/// Number of solved nodes whose first candidate in the order of
+	/// exploration turned out to be the optimal guess.
+	unsigned long long first_best;
+
+	/// Sum over the solved nodes of the difference (in steps) between
+	/// the optimal cost and the lowest lower bound of any candidate.
+	unsigned long long bound_gap;
+
+	/// Number of cells below a node solved by an obvious strategy.
+	unsigned long long obvious;
+
+	/// Number of cells below a node solved in closed form by the endgame
+	/// solver.
+	unsigned long long endgame;
+
+	/// Time spent in the nodes, including their subtrees, in seconds.
+	double seconds;
+
+	DepthStatistics()
+		: nodes(0), solved(0), candidates(0), pruned_bound(0), explored(0),
+		pruned_threshold(0), first_best(0), bound_gap(0), obvious(0),
+		endgame(0), seconds(0.0) { }
+};
+
+/**
+ * Collects per-depth statistics of an optimal strategy search, which help
+ * to tell where a tighter bound or a better ordering of the candidates
+ * would pay off. The statistics may be updated concurrently from multiple
+ * threads.
+ *
+ * @ingroup Optimal
+ */
+class SearchStatistics
+{
+public:
+
+	/// Maximum depth recorded; deeper nodes are counted at this depth.
+	static const int MaxDepth = 31;
+
+private:
+
+	std::array<DepthStatistics, MaxDepth + 1> _depths;
+
+public:
+
+	/// Returns the statistics of the given depth.
+	const DepthStatistics& operator [] (int depth) const
+	{
+		return _depths[depth < MaxDepth ? depth : MaxDepth];
+	}
+
+	/// Adds @c n to a counter of the given depth.
+	void add(int depth, unsigned long long DepthStatistics::*field,
+		unsigned long long n)
+	{
+		unsigned long long &x = _depths[depth < MaxDepth ? depth : MaxDepth].*field;
+#if _OPENMP
+		#pragma omp atomic
+#endif
+		x += n;
+	}
+
+	/// Adds the time spent in a node to the given depth.
+	void add_time(int depth, double seconds)
+	{
+		double &x = _depths[depth < MaxDepth ? depth : MaxDepth].seconds;
+#if _OPENMP
+		#pragma omp atomic
+#endif
+		x += seconds;
+	}
+
+	/// Writes the statistics as a JSON object with one element per depth
+	/// in the array @c depths, up to the deepest node expanded.
+	void write_json(std::ostream &os) const;
+};
+
+} // namespace Mastermind
+
+#endif // MASTERMIND_SEARCH_STATISTICS_HPP
@@ -104,19 +104,30 @@ struct StrategyCost
 	StrategyCost(unsigned int _steps, unsigned short _depth, unsigned short _worst)
 		: worst(_worst),  depth(_depth), steps(_steps) { }
 
+	/// Combines the cost of a disjoint part of the secrets. The steps are
+	/// added, the depth is the greater of the two, and the secrets revealed
+	/// at that depth are counted from both parts.
 	StrategyCost& operator += (const StrategyCost &c)
 	{
 		steps += c.steps;
-		depth = std::max(depth, c.depth);
+		if (c.depth > depth)
+		{
+			depth = c.depth;
+			worst = c.worst;
+		}
+		else if (c.depth == depth)
+		{
+			worst = (unsigned short)(worst + c.worst);
+		}
 		return *this;
 	}
 
 	StrategyCost& operator -= (const StrategyCost &c)
 	{
 		assert(steps >= c.steps);
-		// @todo The following assertion often fails; we need to amend the
-		// optimal strategy code to avoid the use of -=.
-		//assert(depth >= c.depth);
+		// Only the steps can be subtracted; the depth and worst count of
+		// the remainder cannot be recovered from the aggregate. Callers
+		// that need them must aggregate the remaining parts again.
 		steps -= c.steps;
 		return *this;
 	}
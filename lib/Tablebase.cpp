@@ -0,0 +1,401 @@
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <numeric>
+#include <vector>
+
+#include "Tablebase.hpp"
+#include "util/call_counter.hpp"
+
+namespace Mastermind {
+
+/// Maximum number of nodes visited when computing a canonical form. The
+/// search may branch a lot on highly symmetric sets; if this limit is
+/// reached, the set is simply not stored in the tablebase.
+#define TABLEBASE_CANONICAL_LIMIT 20000
+
+namespace {
+
+/**
+ * Depth-first search for the lexicographically smallest image of a set
+ * of codewords whose pegs have been permuted. The codewords are placed in
+ * the order of their signature, which is invariant under permutation.
+ * At each level, the next codeword is one with the required signature
+ * that yields the smallest value after relabeling its new colors in the
+ * order they appear; ties are resolved by branching.
+ */
+class CanonicalSearch
+{
+	int _pegs;
+	int _size;
+	const int8_t *_digits;         // _size codewords of _pegs digits each
+	const unsigned long long *_signature; // signature of each codeword
+	const unsigned long long *_order; // signature required at each level
+	unsigned int _current[64];     // values of the codewords placed so far
+	int8_t _map[MM_MAX_COLORS];    // label of each color; -1 if unassigned
+	size_t _nodes;
+
+public:
+
+	unsigned int best[64];         // smallest image found so far
+	int8_t best_map[MM_MAX_COLORS];
+	bool found;
+	bool improved;
+	bool aborted;
+
+	CanonicalSearch(int pegs, int size,
+		const unsigned long long *signature, const unsigned long long *order)
+		: _pegs(pegs), _size(size), _digits(NULL), _signature(signature),
+		_order(order), _nodes(0), found(false), improved(false),
+		aborted(false) { }
+
+	void search(const int8_t *digits)
+	{
+		_digits = digits;
+		std::fill(_map + 0, _map + MM_MAX_COLORS, (int8_t)-1);
+		improved = false;
+		search(0, 0, 0);
+	}
+
+private:
+
+	// Returns the value of the k-th codeword if it is placed next.
+	unsigned int value(int k, int next_label) const
+	{
+		const int8_t *w = _digits + k * _pegs;
+		int8_t fresh[MM_MAX_PEGS];
+		int nfresh = 0;
+		unsigned int v = 0;
+		for (int i = 0; i < _pegs; ++i)
+		{
+			int label = _map[(int)w[i]];
+			if (label < 0)
+			{
+				int j = 0;
+				while (j < nfresh && fresh[j] != w[i])
+					++j;
+				if (j == nfresh)
+					fresh[nfresh++] = w[i];
+				label = next_label + j;
+			}
+			v = (v << 4) | (unsigned int)label;
+		}
+		return v;
+	}
+
+	// Assigns labels to the new colors of the k-th codeword.
+	int assign(int k, int next_label)
+	{
+		const int8_t *w = _digits + k * _pegs;
+		for (int i = 0; i < _pegs; ++i)
+		{
+			if (_map[(int)w[i]] < 0)
+				_map[(int)w[i]] = (int8_t)next_label++;
+		}
+		return next_label;
+	}
+
+	void search(int level, unsigned long long used, int next_label)
+	{
+		if (aborted || ++_nodes > TABLEBASE_CANONICAL_LIMIT)
+		{
+			aborted = true;
+			return;
+		}
+
+		if (level == _size)
+		{
+			if (!found || std::lexicographical_compare(
+				_current, _current + _size, best, best + _size))
+			{
+				std::copy(_current, _current + _size, best);
+				std::copy(_map + 0, _map + MM_MAX_COLORS, best_map);
+				found = true;
+				improved = true;
+			}
+			return;
+		}
+
+		// Find the smallest value of the next codeword.
+		unsigned int values[64];
+		unsigned int vmin = ~0u;
+		for (int k = 0; k < _size; ++k)
+		{
+			if (!(used & (1ULL << k)) && _signature[k] == _order[level])
+				vmin = std::min(vmin, values[k] = value(k, next_label));
+		}
+
+		// Prune this branch if its prefix is already larger than the
+		// best image found so far.
+		_current[level] = vmin;
+		if (found && std::lexicographical_compare(
+			best, best + level + 1, _current, _current + level + 1))
+			return;
+
+		// Count the number of remaining codewords that contain each color.
+		int owners[MM_MAX_COLORS] = { 0 };
+		for (int k = 0; k < _size; ++k)
+		{
+			if (!(used & (1ULL << k)))
+			{
+				unsigned int mask = 0;
+				for (int i = 0; i < _pegs; ++i)
+					mask |= 1u << _digits[k * _pegs + i];
+				for (int c = 0; c < MM_MAX_COLORS; ++c)
+					owners[c] += (mask >> c) & 1;
+			}
+		}
+
+		// Try each codeword that yields the smallest value. If the new
+		// colors of two such codewords appear in no other remaining
+		// codeword, swapping these colors maps one codeword to the other
+		// and leaves the rest unchanged, so only one of them is tried.
+		bool tried_private = false;
+		for (int k = 0; k < _size; ++k)
+		{
+			if (!(used & (1ULL << k)) && _signature[k] == _order[level] &&
+				values[k] == vmin)
+			{
+				bool is_private = true;
+				for (int i = 0; i < _pegs; ++i)
+				{
+					int c = _digits[k * _pegs + i];
+					if (_map[c] < 0 && owners[c] > 1)
+						is_private = false;
+				}
+				if (is_private && tried_private)
+					continue;
+				tried_private = tried_private || is_private;
+
+				int8_t saved[MM_MAX_COLORS];
+				std::copy(_map + 0, _map + MM_MAX_COLORS, saved);
+				_current[level] = vmin;
+				search(level + 1, used | (1ULL << k), assign(k, next_label));
+				std::copy(saved + 0, saved + MM_MAX_COLORS, _map);
+			}
+		}
+	}
+};
+
+} // anonymous namespace
+
+std::string Tablebase::canonicalize(
+	CodewordConstRange set,
+	CodewordPermutation &perm) const
+{
+	const int p = _rules.pegs();
+	const int n = (int)set.size();
+	assert(n <= 64);
+
+	// Compute a signature of each codeword from the feedbacks it yields
+	// against the other codewords in the set. The signatures do not change
+	// if the set is permuted, and are used to order the codewords, which
+	// greatly reduces the branching of the search.
+	unsigned long long signature[64], order[64];
+	for (int k = 0; k < n; ++k)
+	{
+		signature[k] = 0;
+		for (int l = 0; l < n; ++l)
+		{
+			if (l == k)
+				continue;
+			int nA = 0, nAB = 0;
+			for (int i = 0; i < p; ++i)
+				nA += (set[k][i] == set[l][i])? 1 : 0;
+			for (int c = 0; c < _rules.colors(); ++c)
+				nAB += std::min(set[k].count(c), set[l].count(c));
+			unsigned long long x = (unsigned long long)(nA * 16 + nAB + 1);
+			signature[k] += x * x * 0x9e3779b97f4a7c15ULL;
+		}
+	}
+	std::copy(signature, signature + n, order);
+	std::sort(order, order + n);
+
+	// Compute a signature of each peg from the number of times each color
+	// appears on that peg. Only the peg permutations that sort the pegs by
+	// their signature need to be tried.
+	unsigned long long peg_signature[MM_MAX_PEGS];
+	for (int i = 0; i < p; ++i)
+	{
+		int freq[MM_MAX_COLORS] = { 0 };
+		for (int k = 0; k < n; ++k)
+			++freq[set[k][i]];
+		peg_signature[i] = 0;
+		for (int c = 0; c < MM_MAX_COLORS; ++c)
+		{
+			unsigned long long x = (unsigned long long)freq[c];
+			peg_signature[i] += x * x * x * 0x9e3779b97f4a7c15ULL + x;
+		}
+	}
+
+	CanonicalSearch search(p, n, signature, order);
+	std::vector<int8_t> digits(n * p);
+	int sigma[MM_MAX_PEGS];
+	int best_sigma[MM_MAX_PEGS];
+	std::iota(sigma + 0, sigma + p, 0);
+	do
+	{
+		// Skip this peg permutation if it does not sort the pegs.
+		unsigned long long sorted[MM_MAX_PEGS];
+		for (int i = 0; i < p; ++i)
+			sorted[sigma[i]] = peg_signature[i];
+		if (!std::is_sorted(sorted, sorted + p))
+			continue;
+
+		// Permute the pegs of each codeword, then search for the smallest
+		// image under this peg permutation.
+		for (int k = 0; k < n; ++k)
+		{
+			for (int i = 0; i < p; ++i)
+				digits[k * p + sigma[i]] = (int8_t)set[k][i];
+		}
+		search.search(&digits[0]);
+		if (search.aborted)
+			return std::string();
+		if (search.improved)
+			std::copy(sigma + 0, sigma + p, best_sigma);
+	}
+	while (std::next_permutation(sigma + 0, sigma + p));
+
+	// Build the permutation that maps the set to its canonical form.
+	// Colors that do not appear in the set take the remaining labels.
+	perm = CodewordPermutation();
+	for (int i = 0; i < p; ++i)
+		perm.peg[i] = (int8_t)best_sigma[i];
+	bool taken[MM_MAX_COLORS] = { false };
+	for (int c = 0; c < MM_MAX_COLORS; ++c)
+	{
+		if (search.best_map[c] >= 0)
+			taken[(int)search.best_map[c]] = true;
+	}
+	int free_label = 0;
+	for (int c = 0; c < MM_MAX_COLORS; ++c)
+	{
+		if (search.best_map[c] >= 0)
+		{
+			perm.color[c] = search.best_map[c];
+		}
+		else
+		{
+			while (taken[free_label])
+				++free_label;
+			perm.color[c] = (int8_t)free_label++;
+		}
+	}
+
+	// Encode the canonical form as a string of digits.
+	std::string key(n * p, '0');
+	for (int k = 0; k < n; ++k)
+	{
+		for (int i = 0; i < p; ++i)
+			key[k * p + i] = (char)('0' + ((search.best[k] >> (4 * (p - 1 - i))) & 0xF));
+	}
+	return key;
+}
+
+bool Tablebase::lookup(
+	CodewordConstRange set,
+	StrategyCost &cost,
+	Codeword &guess) const
+{
+	if (!covers(set.size()))
+		return false;
+
+	CodewordPermutation perm;
+	std::string key = canonicalize(set, perm);
+	if (key.empty())
+		return false;
+
+	bool found = false;
+	Entry entry;
+#if _OPENMP
+	#pragma omp critical (Tablebase)
+#endif
+	{
+		std::unordered_map<std::string, Entry>::const_iterator it = _table.find(key);
+		if (it != _table.end())
+		{
+			entry = it->second;
+			found = true;
+		}
+	}
+	UPDATE_CALL_COUNTER("Tablebase_Hit", found ? 1 : 0);
+	if (!found)
+		return false;
+
+	cost = entry.cost;
+	guess = perm.inverse().permute(Codeword::unpack(entry.guess));
+	return true;
+}
+
+void Tablebase::store(
+	CodewordConstRange set,
+	const StrategyCost &cost,
+	const Codeword &guess)
+{
+	if (!covers(set.size()))
+		return;
+
+	CodewordPermutation perm;
+	std::string key = canonicalize(set, perm);
+	if (key.empty())
+		return;
+
+	Entry entry;
+	entry.cost = cost;
+	entry.guess = perm.permute(guess).pack();
+#if _OPENMP
+	#pragma omp critical (Tablebase)
+#endif
+	_table.insert(std::make_pair(key, entry));
+}
+
+bool Tablebase::load(const std::string &filename)
+{
+	std::ifstream is(filename.c_str());
+	if (!is)
+		return false;
+
+	// Check that the file was created for the same rules and objective.
+	std::string magic;
+	int pegs, colors, repeatable, obj;
+	if (!(is >> magic >> pegs >> colors >> repeatable >> obj))
+		return false;
+	if (magic != "MMTB" || pegs != _rules.pegs() ||
+		colors != _rules.colors() || (repeatable != 0) != _rules.repeatable() ||
+		obj != (int)_obj)
+		return false;
+
+	std::string key;
+	unsigned int steps, depth, worst;
+	Entry entry;
+	while (is >> key >> steps >> depth >> worst >> std::hex >> entry.guess >> std::dec)
+	{
+		if (key.size() % pegs != 0 || !covers(key.size() / pegs))
+			continue;
+		entry.cost = StrategyCost(steps, (unsigned short)depth, (unsigned short)worst);
+		_table.insert(std::make_pair(key, entry));
+	}
+	return is.eof();
+}
+
+bool Tablebase::save(const std::string &filename) const
+{
+	std::ofstream os(filename.c_str());
+	if (!os)
+		return false;
+
+	os << "MMTB " << _rules.pegs() << ' ' << _rules.colors() << ' '
+		<< (_rules.repeatable()? 1 : 0) << ' ' << (int)_obj << std::endl;
+	for (std::unordered_map<std::string, Entry>::const_iterator it = _table.begin();
+		it != _table.end(); ++it)
+	{
+		const Entry &entry = it->second;
+		os << it->first << ' ' << entry.cost.steps << ' ' << entry.cost.depth
+			<< ' ' << entry.cost.worst << ' ' << std::hex << entry.guess
+			<< std::dec << std::endl;
+	}
+	return !!os;
+}
+
+} // namespace Mastermind
@@ -0,0 +1,92 @@
+#ifndef MASTERMIND_TABLEBASE_HPP
+#define MASTERMIND_TABLEBASE_HPP
+
+#include <string>
+#include <unordered_map>
+
+#include "Rules.hpp"
+#include "Codeword.hpp"
+#include "Permutation.hpp"
+#include "Strategy.hpp"
+
+namespace Mastermind {
+
+/**
+ * Endgame tablebase that stores the exact optimal cost of small sets of
+ * remaining secrets, together with an optimal first guess.
+ *
+ * The optimal cost of a secret set (when any codeword may be guessed)
+ * does not change if the pegs and colors of the secrets are permuted.
+ * Therefore each set is stored under a canonical form, which is the
+ * lexicographically smallest list of codewords that the set can be
+ * mapped to by a peg permutation, an ordering of its elements, and a
+ * relabeling of the colors in the order they first appear. The optimal
+ * guess is stored in the coordinates of the canonical form and mapped
+ * back to the coordinates of the set on lookup.
+ *
+ * The tablebase is filled with the subproblems solved by an optimal
+ * search, and can be saved to and loaded from a file so that later
+ * searches with the same rules and objective reuse the results.
+ *
+ * The tablebase may be accessed concurrently from multiple threads.
+ *
+ * @ingroup Optimal
+ */
+class Tablebase
+{
+public:
+
+	/// Entry of the tablebase.
+	struct Entry
+	{
+		StrategyCost cost;            // optimal cost of the set
+		Codeword::compact_type guess; // optimal guess in canonical form
+	};
+
+private:
+
+	Rules _rules;
+	StrategyObjective _obj;
+	size_t _max_size;
+	std::unordered_map<std::string, Entry> _table;
+
+	// Computes the canonical form of a set of codewords, and the
+	// permutation that maps the set to its canonical form.
+	std::string canonicalize(
+		CodewordConstRange set,
+		CodewordPermutation &perm) const;
+
+public:
+
+	/// Creates an empty tablebase for sets of at most @c max_size secrets.
+	Tablebase(const Rules &rules, StrategyObjective obj, size_t max_size)
+		: _rules(rules), _obj(obj), _max_size(max_size) { }
+
+	/// Returns the maximum size of a set stored in the tablebase.
+	size_t max_size() const { return _max_size; }
+
+	/// Returns the number of sets stored in the tablebase.
+	size_t size() const { return _table.size(); }
+
+	/// Tests whether a set of @c n secrets is covered by the tablebase.
+	/// Sets of two or fewer secrets are trivial and are not stored.
+	bool covers(size_t n) const { return n >= 3 && n <= _max_size; }
+
+	/// Looks up the optimal cost and an optimal guess of a set of
+	/// secrets. Returns @c true if found, or @c false otherwise.
+	bool lookup(CodewordConstRange set, StrategyCost &cost, Codeword &guess) const;
+
+	/// Stores the optimal cost and an optimal guess of a set of secrets.
+	void store(CodewordConstRange set, const StrategyCost &cost, const Codeword &guess);
+
+	/// Loads entries from a file. Returns @c false if the file cannot be
+	/// read or was created for different rules or objective.
+	bool load(const std::string &filename);
+
+	/// Saves all entries to a file. Returns @c false on failure.
+	bool save(const std::string &filename) const;
+};
+
+} // namespace Mastermind
+
+#endif // MASTERMIND_TABLEBASE_HPP
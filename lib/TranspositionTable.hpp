@@ -0,0 +1,192 @@
+#ifndef MASTERMIND_TRANSPOSITION_TABLE_HPP
+#define MASTERMIND_TRANSPOSITION_TABLE_HPP
+
+#include <cassert>
+#include <vector>
+
+#include "Engine.hpp"
+#include "Strategy.hpp"
+#include "util/call_counter.hpp"
+
+namespace Mastermind {
+
+/**
+ * Hash table that memoizes the subproblems solved by an optimal strategy
+ * search.
+ *
+ * A subproblem is identified by the set of remaining secrets, the list of
+ * candidate guesses (which reflects the state of the equivalence filters),
+ * and the maximum depth allowed. For each subproblem, the table stores
+ * either the optimal cost together with the optimal guess, or a lower
+ * bound of the cost proven by a failed (pruned) search. The optimal guesses
+ * are also used to build the strategy tree after the search.
+ *
+ * The table has a fixed number of entries, organized in buckets of two.
+ * The first entry of a bucket keeps the largest subproblem stored in it;
+ * the second entry is always replaced.
+ *
+ * The table may be accessed concurrently from multiple threads.
+ *
+ * @ingroup Optimal
+ */
+class TranspositionTable
+{
+public:
+
+	/// Type of the hash key of a subproblem.
+	typedef unsigned long long key_type;
+
+	/// Type of an entry.
+	enum EntryType
+	{
+		/// The entry is empty.
+		Empty = 0,
+		/// The cost of the entry is the optimal cost.
+		Exact = 1,
+		/// The optimal cost is not superior to the cost of the entry.
+		LowerBound = 2
+	};
+
+	/// Entry of the table.
+	struct Entry
+	{
+		key_type key;          // hash key of the subproblem
+		StrategyCost cost;     // optimal cost, or lower bound of the cost
+		Codeword::compact_type guess; // optimal guess if exact
+		unsigned int size;     // number of secrets in the subproblem
+		unsigned char type;    // type of the entry; see EntryType
+
+		Entry() : key(0), cost(), guess(0), size(0), type(Empty) { }
+	};
+
+	/// Returns the hash key of a codeword.
+	static key_type hash(const Codeword &w)
+	{
+		// Uses the 64-bit finalizer of MurmurHash3.
+		key_type k = w.pack();
+		k ^= k >> 33;
+		k *= 0xff51afd7ed558ccdULL;
+		k ^= k >> 33;
+		k *= 0xc4ceb9fe1a85ec53ULL;
+		k ^= k >> 33;
+		return k;
+	}
+
+	/// Returns the hash key of a set of codewords. This is the exclusive-or
+	/// of the keys of its elements (Zobrist hashing), which does not depend
+	/// on the order of the elements and can therefore be computed from the
+	/// cells of a partition without sorting them.
+	static key_type hash_set(CodewordConstRange set)
+	{
+		key_type k = 0;
+		for (CodewordConstIterator it = set.begin(); it != set.end(); ++it)
+			k ^= hash(*it);
+		return k;
+	}
+
+	/// Returns the hash key of a sequence of codewords, which depends on
+	/// the order of the elements.
+	static key_type hash_sequence(CodewordConstRange list)
+	{
+		key_type k = list.size();
+		for (CodewordConstIterator it = list.begin(); it != list.end(); ++it)
+			k = (k * 0x100000001b3ULL) ^ hash(*it);
+		return k;
+	}
+
+	/// Combines the keys of the secret set, the candidate list, and the
+	/// maximum depth into the key of a subproblem.
+	static key_type combine(key_type secrets, key_type candidates, int max_depth)
+	{
+		key_type k = secrets ^ ((candidates << 29) | (candidates >> 35));
+		return k ^ ((key_type)max_depth * 0x9e3779b97f4a7c15ULL);
+	}
+
+private:
+
+	std::vector<Entry> _entries;
+	size_t _mask; // mask of the bucket index
+
+public:
+
+	/// Creates a transposition table with at most @c size entries.
+	explicit TranspositionTable(size_t size) : _mask(0)
+	{
+		size_t buckets = 1;
+		while (buckets * 4 <= size)
+			buckets *= 2;
+		_entries.resize(buckets * 2);
+		_mask = buckets - 1;
+	}
+
+	/// Returns the number of entries in the table.
+	size_t size() const { return _entries.size(); }
+
+	/// Looks up a subproblem of @c size secrets. Returns @c true and
+	/// copies the entry to @c entry if found, or returns @c false
+	/// otherwise. An entry whose key collides with that of a subproblem of
+	/// a different size is not returned.
+	bool lookup(key_type key, unsigned int size, Entry &entry) const
+	{
+		const Entry *bucket = &_entries[(key & _mask) * 2];
+		bool found = false;
+#if _OPENMP
+		#pragma omp critical (TranspositionTable)
+#endif
+		{
+			for (int i = 0; i < 2 && !found; ++i)
+			{
+				if (bucket[i].type != Empty && bucket[i].key == key &&
+					bucket[i].size == size)
+				{
+					entry = bucket[i];
+					found = true;
+				}
+			}
+		}
+		UPDATE_CALL_COUNTER("TranspositionTable_Hit", found ? 1 : 0);
+		return found;
+	}
+
+	/// Stores a subproblem. An existing entry of the same subproblem is
+	/// updated if the new entry carries more information.
+	void store(const Entry &entry, StrategyObjective obj)
+	{
+		assert(entry.type != Empty);
+		Entry *bucket = &_entries[(entry.key & _mask) * 2];
+#if _OPENMP
+		#pragma omp critical (TranspositionTable)
+#endif
+		{
+			Entry *target = NULL;
+			for (int i = 0; i < 2; ++i)
+			{
+				if (bucket[i].type != Empty && bucket[i].key == entry.key &&
+					bucket[i].size == entry.size)
+					target = &bucket[i];
+			}
+			if (target)
+			{
+				// Keep an exact entry, or the tighter of two lower bounds.
+				if (target->type == LowerBound && (entry.type == Exact ||
+					superior(target->cost, entry.cost, obj)))
+				{
+					*target = entry;
+				}
+			}
+			else if (entry.size >= bucket[0].size)
+			{
+				bucket[1] = bucket[0];
+				bucket[0] = entry;
+			}
+			else
+			{
+				bucket[1] = entry;
+			}
+		}
+	}
+};
+
+} // namespace Mastermind
+
+#endif // MASTERMIND_TRANSPOSITION_TABLE_HPP
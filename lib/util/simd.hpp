@@ -162,6 +162,9 @@ operator |= (simd_t<T,N,__m128i> &a, T b)
 
 // @}
 
+/// Element-wise addition with wrap-around.
+inline xmm_u8 operator + (const xmm_u8 &a, const xmm_u8 &b) { return _mm_add_epi8(a, b); }
+
 /// Element-wise comparison for equality.
 inline xmm_i8 operator == (const xmm_i8 &a, const xmm_i8 &b) { return _mm_cmpeq_epi8(a, b); }
 inline xmm_u8 operator == (const xmm_u8 &a, const xmm_u8 &b) { return _mm_cmpeq_epi8(a, b); }
@@ -278,16 +281,16 @@ inline unsigned int sum(const simd_t<uint8_t,16> &a)
 } } // namespace util::simd
 
 
-#if 0
+#if __SSSE3__
 #include <tmmintrin.h>
 
 namespace util { namespace simd {
-	
-#define SIMD_REQUIRE(version)
 
-SIMD_REQUIRE("SSSE3")
+/// Selects the bytes of @c a given by the indices in @c perm. An index
+/// with its most significant bit set selects zero. Requires SSSE3.
+/// @ingroup SIMD
 inline simd_t<uint8_t,16> 
-shuffle(const simd_t<uint8_t,16> &a, const simd_t<int8_t,16> &perm)
+shuffle(const simd_t<uint8_t,16> &a, const simd_t<uint8_t,16> &perm)
 {
 	return _mm_shuffle_epi8(a, perm);
 }
@@ -65,6 +65,10 @@ private:
 		/// Index of the node.
 		size_t _index;
 
+		/// Incomplete type that takes the place of the converting
+		/// constructor's argument in a mutable iterator.
+		struct no_conversion;
+
 	public:
 
 		/// Iterator category.
@@ -87,8 +91,11 @@ private:
 		/// Constructs an unspecified iterator.
 		node_iterator() : _tree(0), _index(0) { }
 
-		/// Copy-constructs an iterator.
-		node_iterator(const node_iterator<false> &other)
+		/// Converts a mutable iterator to a const iterator. A mutable
+		/// iterator is copied and assigned by the implicit members instead,
+		/// so that this constructor is never its copy constructor.
+		node_iterator(const typename std::conditional<IsConst,
+			node_iterator<false>, no_conversion>::type &other)
 			: _tree(other._tree), _index(other._index) { }
 
 		/// Constructs an iterator that points to a specific node in a tree.
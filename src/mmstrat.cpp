@@ -14,150 +14,13 @@
 #include "SimpleStrategy.hpp"
 #include "HeuristicStrategy.hpp"
 #include "OptimalStrategy.hpp"
+#include "TranspositionTable.hpp"
 #include "CodeBreaker.hpp"
 #include "Heuristics.hpp"
 #include "util/io_format.hpp"
 
 using namespace Mastermind;
 
-#if 0
-
-// c.f. http://www.javaworld.com.tw/jute/post/view?bid=35&id=138372&sty=1&tpg=1&ppg=1&age=0#138372
-
-static int GetMaxBreakableWithin(
-	int nsteps,
-	int f[],
-	CodewordList possibilities,
-	CodewordList all,
-	unsigned short unguessed_mask,
-	int expand_levels)
-{
-	assert(nsteps >= 0);
-	assert(expand_levels >= 0);
-
-	if (nsteps == 0) {
-		return 0;
-	} else if (nsteps == 1) {
-		return 1;
-	}
-	//else if (nsteps == 2) {
-	//	int npegs = possibilities.GetRules().length;
-	//	return std::min(possibilities.GetCount(), npegs*(npegs+3)/2);
-	//}
-
-	unsigned short impossible_mask = ((1<<all.GetRules().ndigits)-1) & ~possibilities.GetDigitMask();
-	CodewordList candidates = all.FilterByEquivalence(unguessed_mask, impossible_mask);
-	int best = 0;
-	for (int i = 0; i < candidates.GetCount(); i++) {
-		Codeword guess = candidates[i];
-
-		int nguessable = 0;
-		if (expand_levels == 0) {
-			FeedbackFrequencyTable freq(FeedbackList(guess, possibilities));
-			for (int fbv = 0; fbv <= freq.GetMaxFeedbackValue(); fbv++) {
-				int partition_size = freq[Feedback(fbv)];
-				nguessable += std::min(f[nsteps-1], partition_size);
-			}
-		} else {
-			FeedbackFrequencyTable freq;
-			possibilities.Partition(guess, freq);
-			int partition_start = 0;
-			for (int fbv = 0; fbv <= freq.GetMaxFeedbackValue(); fbv++) {
-				int partition_size = freq[Feedback(fbv)];
-				if (partition_size == 0)
-					continue;
-
-				CodewordList filtered(possibilities, partition_start, partition_size);
-				int tmpcount = GetMaxBreakableWithin(nsteps-1, f, filtered, all,
-					unguessed_mask & ~guess.GetDigitMask(),
-					expand_levels-1);
-				nguessable += std::min(tmpcount, partition_size);
-				partition_start += partition_size;
-			}
-		}
-
-		best = std::max(best, nguessable);
-	}
-	return best;
-}
-
-static int TestBound(Rules rules)
-{
-	// Find out the maximum size of any partition
-	CodewordList all = CodewordList::Enumerate(rules);
-	FeedbackFrequencyTable freq(FeedbackList(all[0], all));
-
-	int f[100];
-	f[0] = 0;
-	f[1] = 1;
-	int min_rounds = 0;
-	int expand_levels = 1;
-	for (int n = 2; n < 100; n++) {
-		unsigned short unguessed_mask = ((1<<all.GetRules().ndigits)-1);
-		f[n] = GetMaxBreakableWithin(n, f, all.Copy(), all, unguessed_mask, expand_levels);
-		if (f[n] >= all.GetCount()) {
-			min_rounds = n;
-			break;
-		}
-	}
-	for (int n = 1; n <= min_rounds; n++) {
-		printf("Maximum number of secrets that can be guessed in %2d rounds: <= %d\n",
-			n, f[n]);
-	}
-	printf("**** Minimum number of rounds necessary to guess all secrets: >= %d\n",
-		min_rounds);
-
-	int min_steps = all.GetCount()*min_rounds;
-	for (int n = 1; n < min_rounds; n++) {
-		min_steps -= f[n];
-	}
-	printf("**** Minimum total steps necessary to guess all secrets: >= %d\n",
-		min_steps);
-	printf("**** Minimum average steps necessary to guess all secrets: >= %5.3f\n",
-		(double)min_steps/all.GetCount());
-
-	int *S = Mastermind::Heuristics::MinimizeSteps::partition_score;
-	S[0] = 0;
-	for (int i = 1; i <= all.GetCount(); i++) {
-		int nr = 0;
-		for (nr = 1; nr <= 100; nr++) {
-			if (f[nr] >= i)
-				break;
-		}
-		int score = i*nr;
-		for (int j = 1; j < nr; j++) {
-			score -= f[j];
-		}
-		S[i] = score;
-		//if (i % 40==0)
-		//printf("S[%d] = %d\n", i, score);
-	}
-
-#if 0
-	int m=14;
-
-	const int nmax=20;
-	int S[nmax+1];
-	S[0]=0;
-	int n;
-	for (n = 1; n <= nmax; n++) {
-		if (n <= m) {
-			S[n] = 1+(n-1)*2;
-		} else {
-			S[n]=n;
-			int nper = (n-1)/(m-1);
-			S[n] += S[nper]*(m-2);
-			S[n] += S[(n-1)-(nper*(m-2))];
-		}
-		printf("S[%4d] = %d\n", n, S[n]);
-	}
-#endif
-
-	//system("PAUSE");
-	return 0;
-}
-#endif
-
 static void usage()
 {
 	std::cerr <<
@@ -199,7 +62,12 @@ static void usage()
 		"                default     composite filter (color + constraint)\n"
 		"                color       filter by color equivalence\n"
 		"                constraint  filter by constraint equivalence\n"
+		"                automorphism  default filter, then filter by the\n"
+		"                            automorphisms of the remaining secrets\n"
 		"                none        do not apply any filter\n"
+		"    -sample n [k]  score the candidates on a sample of n possibilities\n"
+		"                first, then evaluate the best k candidates exactly\n"
+		"                [default k=32]; only applies to more than 2n possibilities\n"
 		"    -nc         do not apply a correction to the heuristic score\n"
 		"                which favors guesses from remaining possibilities.\n" 
 		"    -no         Do not attempt to make an obvious guess before applying\n"
@@ -207,15 +75,37 @@ static void usage()
 		"                purpose if the heuristic function may yield a guess that\n"
 		"                is different than an obvious guess when one exists.\n"
 		"Options for Optimal Strategies:\n"
-#ifndef NDEBUG
+		"    -aut        also filter the candidates by the automorphisms of the\n"
+		"                remaining secrets; not used with -po\n"
+		"    -cb [n]     tighten the lower bound by counting the secrets that can be\n"
+		"                revealed within each number of guesses, expanding n levels\n"
+		"                [default=1]\n"
+		"    -ckpt file  journal the subproblems solved near the root to 'file'\n"
+		"                as they complete, and resume from it if it exists\n"
+		"    -hist       explore candidates of equal lower bound first if they were\n"
+		"                optimal in related subproblems; the strategy is unchanged\n"
+		"    -jobs dir [t]  split the search into jobs in the existing directory\n"
+		"                'dir', and solve them together with any workers serving\n"
+		"                'dir'; stop waiting for the other workers if none of their\n"
+		"                jobs completes in t seconds [default t=600]\n"
 		"    -md depth   set the maximum number of guesses allowed to reveal a secret\n"
-#endif
+		"    -mtd        find the optimal cost by a series of searches with narrow\n"
+		"                thresholds above the lower bound\n"
 		"    -O level    specify the level of optimization, which is one of:\n"
 		"                1 - (default) minimize steps\n"
-#ifndef NDEBUG
 		"                2 - minimize steps, then depth\n"
 		"                3 - minimize steps, then depth, then worst count\n"
-#endif
+		"    -progress   report the progress of the search to stderr\n"
+		"    -tb file [n]  load the endgame tablebase from 'file' and save it back\n"
+		"                after the search; it stores sets of up to n secrets\n"
+		"                [default n=8]; not used with -po\n"
+		"    -tt size    set the size (in MB) of the transposition table that\n"
+		"                memoizes solved subproblems; 0 disables it [default=32]\n"
+		"    -ub name    build the heuristic strategy 'name' first, and use its\n"
+		"                cost of each state as an upper bound to prune the search\n"
+		"    -worker dir [t]  solve the jobs posted to 'dir' by a search with -jobs\n"
+		"                and the same options, then exit without output; fail if\n"
+		"                no jobs are posted in t seconds [default t=600]\n"
 		"";
 }
 
@@ -230,7 +120,6 @@ static void version()
 		"";
 }
 
-// TODO: Add progress display to OptimalCodeBreaker
 // TODO: Output strategy tree after finishing a run
 
 extern int test(const Rules &rules, bool verbose);
@@ -244,27 +133,38 @@ extern int test(const Rules &rules, bool verbose);
 		if (!(cond)) USAGE_ERROR(msg); \
 	} while (0)
 
+template <class Heuristic>
+static Strategy* create_heuristic_strategy(
+	const Engine *e, const Heuristic &h, size_t sample_size, size_t leaders)
+{
+	HeuristicStrategy<Heuristic> *strat = new HeuristicStrategy<Heuristic>(e, h);
+	strat->set_sampling(sample_size, leaders);
+	return strat;
+}
+
 static int build_heuristic_strategy_tree(
 	const Engine *e, const EquivalenceFilter *filter, int /* verbose */,
 	const std::string &name, StrategyConstraints constraints,
-	bool no_correction, StrategyTree &tree)
+	bool no_correction, size_t sample_size, size_t leaders,
+	StrategyTree &tree)
 {
 	using namespace Mastermind::Heuristics;
 
 	bool ac = !no_correction; // apply correction
+	size_t n = sample_size, k = leaders;
 	Strategy *strat = NULL;
 	if (name == "simple")
 		strat = new SimpleStrategy();
 	else if (name == "minmax")
-		strat = new HeuristicStrategy<MinimizeWorstCase>(e, MinimizeWorstCase(ac));
+		strat = create_heuristic_strategy(e, MinimizeWorstCase(ac), n, k);
 	else if (name == "minavg")
-		strat = new HeuristicStrategy<MinimizeAverage>(e, MinimizeAverage(ac));
+		strat = create_heuristic_strategy(e, MinimizeAverage(ac), n, k);
 	else if (name == "entropy")
-		strat = new HeuristicStrategy<MaximizeEntropy>(e, MaximizeEntropy(ac));
+		strat = create_heuristic_strategy(e, MaximizeEntropy(ac), n, k);
 	else if (name == "parts")
-		strat = new HeuristicStrategy<MaximizePartitions>(e, MaximizePartitions(ac));
+		strat = create_heuristic_strategy(e, MaximizePartitions(ac), n, k);
 	else if (name == "minlb")
-		strat = new HeuristicStrategy<MinimizeLowerBound>(e, MinimizeLowerBound(e));
+		strat = create_heuristic_strategy(e, MinimizeLowerBound(e), n, k);
 	else
 		USAGE_ERROR("unknown strategy: " << name);
 
@@ -276,15 +176,15 @@ static int build_heuristic_strategy_tree(
 	return 0;
 }
 
-extern StrategyTree build_optimal_strategy_tree(
-	const Engine *e, StrategyObjective obj, StrategyConstraints constraints);
-
 // verbose: 0 = quiet, 1 = verbose, 2 = very verbose
 static int build_strategy(
 	const Engine *e, const EquivalenceFilter *filter, int verbose,
 	const std::string &name, const std::string & /* file */,
+	const std::string &bootstrap,
 	StrategyConstraints constraints, bool no_correction,
-	StrategyObjective obj, bool summary)
+	size_t sample_size, size_t leaders,
+	StrategyObjective obj, const OptimalSearchOptions &options, bool worker,
+	bool summary)
 {
 	using namespace Mastermind::Heuristics;
 
@@ -296,12 +196,34 @@ static int build_strategy(
 	}
 	else if (name == "optimal")
 	{
-		tree = build_optimal_strategy_tree(e, obj, constraints);
+		// Build a heuristic strategy first if requested, and let its costs
+		// seed the pruning thresholds of the optimal search.
+		StrategyTree bootstrap_tree(e->rules());
+		OptimalSearchOptions o(options);
+		if (!bootstrap.empty())
+		{
+			int ret = build_heuristic_strategy_tree(e, filter, verbose,
+				bootstrap, constraints, no_correction, sample_size, leaders,
+				bootstrap_tree);
+			if (ret)
+				return ret;
+			o.bootstrap = &bootstrap_tree;
+		}
+		if (worker)
+		{
+			size_t count;
+			if (!solve_optimal_jobs(e, obj, constraints, o, count))
+				return 1;
+			if (verbose)
+				std::cerr << "Solved " << count << " jobs" << std::endl;
+			return 0;
+		}
+		tree = build_optimal_strategy_tree(e, obj, constraints, o);
 	}
 	else
 	{
 		int ret = build_heuristic_strategy_tree(e, filter, verbose, name,
-			constraints, no_correction, tree);
+			constraints, no_correction, sample_size, leaders, tree);
 		if (ret)
 			return ret;
 	}
@@ -337,6 +259,7 @@ int main(int argc, char* argv[])
 
 	int verbose = 1;
 	std::string strat_name, strat_file, filter_name;
+	std::string bootstrap_name; // heuristic strategy to bootstrap optimal search
 	Codeword secret;
 #ifdef _OPENMP
 	int mt = 1;
@@ -346,12 +269,36 @@ int main(int argc, char* argv[])
 	bool prof = false; // whether to enable profiling (call counting)
 	bool no_correction = false;
 	bool summary = false;
+	size_t sample_size = 0; // sample size for approximate evaluation
+	size_t leaders = 32;    // number of candidates to evaluate exactly
+	OptimalSearchOptions options;
+	bool worker = false; // whether to only solve the jobs of a search
 
 	// Parse command line arguments.
 	for (int i = 1; i < argc; i++)
 	{
 		std::string s = argv[i];
-		if (s == "-e")
+		if (s == "-aut")
+		{
+			options.automorphisms = true;
+		}
+		else if (s == "-cb")
+		{
+			int n = 1;
+			if (i+1 < argc && argv[i+1][0] != '-')
+			{
+				std::string cnt(argv[++i]);
+				USAGE_REQUIRE((std::istringstream(cnt) >> n) && (n > 0),
+					"positive integer argument expected for option -cb");
+			}
+			options.counting_bound = n;
+		}
+		else if (s == "-ckpt")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -ckpt");
+			options.checkpoint = argv[i];
+		}
+		else if (s == "-e")
 		{
 			USAGE_REQUIRE(filter_name.empty(), "only one equivalence filter may be specified");
 			USAGE_REQUIRE(++i < argc, "missing argument for option -f");
@@ -362,6 +309,27 @@ int main(int argc, char* argv[])
 			usage();
 			return 0;
 		}
+		else if (s == "-hist")
+		{
+			options.history = true;
+		}
+		else if (s == "-jobs")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -jobs");
+			options.jobs = argv[i];
+			if (i+1 < argc && argv[i+1][0] != '-')
+			{
+				std::string cnt(argv[++i]);
+				int t;
+				USAGE_REQUIRE((std::istringstream(cnt) >> t) && (t > 0),
+					"positive integer argument expected for option -jobs");
+				options.job_timeout = t;
+			}
+		}
+		else if (s == "-mtd")
+		{
+			options.mtd = true;
+		}
 		else if (s == "-md")
 		{
 			USAGE_REQUIRE(++i < argc, "missing argument for option -md");
@@ -414,6 +382,10 @@ int main(int argc, char* argv[])
 			std::string level = argv[i];
 			if (level == "1")
 				obj = MinSteps;
+			else if (level == "2")
+				obj = MinDepth;
+			else if (level == "3")
+				obj = MinWorst;
 			else
 				USAGE_ERROR("invalid optimization level '" << level << "'");
 		}
@@ -430,6 +402,10 @@ int main(int argc, char* argv[])
 				" and is ignored." << std::endl;
 #endif
 		}
+		else if (s == "-progress")
+		{
+			options.progress = true;
+		}
 		else if (s == "-q")
 		{
 			verbose = 0;
@@ -453,6 +429,22 @@ int main(int argc, char* argv[])
 		{
 			summary = true;
 		}
+		else if (s == "-sample")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -sample");
+			std::string cnt(argv[i]);
+			int n;
+			USAGE_REQUIRE((std::istringstream(cnt) >> n) && (n > 0),
+				"positive integer argument expected for option -sample");
+			sample_size = n;
+			if (i+1 < argc && argv[i+1][0] != '-')
+			{
+				std::string cnt(argv[++i]);
+				USAGE_REQUIRE((std::istringstream(cnt) >> n) && (n > 0),
+					"positive integer argument expected for option -sample");
+				leaders = n;
+			}
+		}
 		else if (s == "-s")
 		{
 			USAGE_REQUIRE(++i < argc, "missing argument for option -s");
@@ -465,11 +457,52 @@ int main(int argc, char* argv[])
 			}
 #endif
 		}
+		else if (s == "-tb")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -tb");
+			options.tablebase = argv[i];
+			if (i+1 < argc && argv[i+1][0] != '-')
+			{
+				std::string cnt(argv[++i]);
+				int n;
+				USAGE_REQUIRE((std::istringstream(cnt) >> n) && (n > 0) && (n <= 64),
+					"integer argument between 1 and 64 expected for option -tb");
+				options.tablebase_size = n;
+			}
+		}
+		else if (s == "-tt")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -tt");
+			std::string cnt(argv[i]);
+			int mb;
+			USAGE_REQUIRE((std::istringstream(cnt) >> mb) && (mb >= 0),
+				"non-negative integer argument expected for option -tt");
+			options.tt_size = (size_t)mb * (1 << 20) / sizeof(TranspositionTable::Entry);
+		}
+		else if (s == "-ub")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -ub");
+			bootstrap_name = argv[i];
+		}
 		else if (s == "-v")
 		{
 			version();
 			return 0;
 		}
+		else if (s == "-worker")
+		{
+			USAGE_REQUIRE(++i < argc, "missing argument for option -worker");
+			options.jobs = argv[i];
+			worker = true;
+			if (i+1 < argc && argv[i+1][0] != '-')
+			{
+				std::string cnt(argv[++i]);
+				int t;
+				USAGE_REQUIRE((std::istringstream(cnt) >> t) && (t > 0),
+					"positive integer argument expected for option -worker");
+				options.job_timeout = t;
+			}
+		}
 		else
 		{
 			USAGE_REQUIRE(false, "unknown option: " << s);
@@ -478,6 +511,8 @@ int main(int argc, char* argv[])
 
 	// Check that a strategy is specified.
 	USAGE_REQUIRE(!strat_name.empty(), "option -s strategy is required.");
+	USAGE_REQUIRE(!worker || strat_name == "optimal",
+		"option -worker requires -s optimal.");
 
 	// Set number of threads.
 #ifdef _OPENMP
@@ -485,8 +520,12 @@ int main(int argc, char* argv[])
 	omp_set_nested(0);
 #endif
 
-	// Enables or disables profiling according to -prof switch.
+	// Enables or disables profiling according to -prof switch. This also
+	// collects the per-depth statistics of an optimal search.
 	util::call_counter::enable(prof);
+	SearchStatistics search_stats;
+	if (prof)
+		options.stats = &search_stats;
 
 	// Create an algorithm engine.
 	Engine engine(rules);
@@ -508,6 +547,15 @@ int main(int argc, char* argv[])
 	{
 		filter = CreateConstraintEquivalenceFilter(e);
 	}
+	else if (filter_name == "automorphism")
+	{
+		std::unique_ptr<EquivalenceFilter> composite(new CompositeEquivalenceFilter(
+			CreateColorEquivalenceFilter(e),
+			CreateConstraintEquivalenceFilter(e)));
+		std::unique_ptr<EquivalenceFilter> automorphism(
+			CreateAutomorphismEquivalenceFilter(e));
+		filter = new CompositeEquivalenceFilter(composite.get(), automorphism.get());
+	}
 	else if (filter_name == "none")
 	{
 		filter = CreateDummyEquivalenceFilter(e);
@@ -520,7 +568,8 @@ int main(int argc, char* argv[])
 
 	// Build the specified strategy for the given rules.
 	int ret = build_strategy(e, filter, verbose, strat_name, strat_file, 
-		constraints, no_correction, obj, summary);
+		bootstrap_name, constraints, no_correction, sample_size, leaders, obj, options,
+		worker, summary);
 
 	// Display available profiling results. It is useful to disgard the 
 	// profiling switch here to detect any code that doesn't respect the
@@ -539,6 +588,11 @@ int main(int argc, char* argv[])
 			if (it->second.total_calls() > 0)
 				std::cout << it->second << std::endl;
 		}
+		if (prof && strat_name == "optimal")
+		{
+			std::cout << "==== Optimal Search Statistics ====" << std::endl;
+			search_stats.write_json(std::cout);
+		}
 	}
 
 	return ret;
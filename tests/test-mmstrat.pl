@@ -5,6 +5,7 @@
 
 use strict;
 use warnings;
+use File::Temp qw(tempdir);
 
 # Path to executable.
 my $exec = 'mmstrat';
@@ -48,20 +49,33 @@ my @test_cases = (
 	# Test optimal strategies.
 	"-r mm -s optimal",         "5625:6:7",
 	"-r mm -s optimal -O 1",    "5625:6:7",
+	"-r mm -s optimal -O 3",    "5625:6:1",
 	"-r mm -s optimal -po",     "5629:6:7",
 	"-r bc -s optimal -po",     "26374:7:126",
+	"-r bc -s optimal -po -tt 0", "26374:7:126",
+	"-r mm -s optimal -cb 2",   "5625:6:7",
+	"-r mm -s optimal -po -ub minavg", "5629:6:7",
+	"-r bc -s optimal -po -hist",      "26374:7:126",
+	"-r mm -s optimal -mtd",    "5625:6:7",
+	"-r mm -s optimal -aut",    "5625:6:7",
 
 	# Test -md switch for optimal strategies.
-	#"-r mm -s optimal -md 10",  "5625:6:7",
-	#"-r mm -s optimal -md 6",   "5625:6:7",
-	#"-r mm -s optimal -md 5",   "5626:5:x",
-	#"-r mm -s optimal -md 4",   "0:0:0",
+	"-r mm -s optimal -md 10",  "5625:6:7",
+	"-r mm -s optimal -md 6",   "5625:6:7",
+	"-r mm -s optimal -md 5",   "5626:5:556",
+	"-r mm -s optimal -md 4",   "0:0:0",
+	"-r mm -s optimal -O 3 -md 5", "5626:5:540",
 
 	# Test different equivalence filters.
 	"-r mm -s minavg -e default",    "5696:6:3",
 	"-r mm -s minavg -e constraint", "5696:6:3",
 	"-r mm -s minavg -e color",      "5696:6:3",
 	"-r mm -s minavg -e none",       "5696:6:3",
+	"-r mm -s minavg -e automorphism", "5696:6:3",
+
+	# Test approximate evaluation on a sample of the possibilities.
+	"-r mm -s minavg -sample 200 2", "5696:6:3",
+	"-r mm -s minavg -sample 100 2", "5693:6:1",
 
 	# Build strategy using 2 threads.
 	"-r mm -mt 2 -s minmax",    "5778:5:663",
@@ -84,14 +98,20 @@ my @test_cases = (
 	"-r p4c8n -s entropy",      "7880:7:2",
 );
 
+# Number of runs in the tests below that keep state in files.
+my $file_tests = 6;
+
 my $last_is_ok = 1;
-for (my $i = 0; $i < $#test_cases; $i += 2)
+my $total = ($#test_cases + 1) / 2 + $file_tests;
+
+# Runs mmstrat with the given options and compares its output with the
+# expected output.
+sub run_test
 {
-	my $opt = $test_cases[$i];
-	my $expect = $test_cases[$i+1];
+	my ($opt, $expect) = @_;
 
 	#print "Running test ", sprintf("%2d", ++$number), " ... ";
-	print sprintf("Running test [ %3d / %3d ] ... ", ++$number, ($#test_cases+1)/2);
+	print sprintf("Running test [ %3d / %3d ] ... ", ++$number, $total);
 
 	my $args = "-S -q $opt";
 	my $cmd = "$exec $args";
@@ -115,6 +135,82 @@ for (my $i = 0; $i < $#test_cases; $i += 2)
 	}
 }
 
+for (my $i = 0; $i < $#test_cases; $i += 2)
+{
+	run_test($test_cases[$i], $test_cases[$i+1]);
+}
+
+# Reports a failed check on the files written by a test.
+sub check_file
+{
+	my ($ok, $message) = @_;
+	return if $ok;
+	print "FAILED\n" if $last_is_ok;
+	print "    $message\n";
+	++$failed;
+	$last_is_ok = 0;
+}
+
+# Test options that keep state in files between runs, in a temporary
+# directory.
+my $dir = tempdir(CLEANUP => 1);
+
+# Build with an endgame tablebase, then again with the tablebase saved
+# by the first run.
+run_test("-r mm -s optimal -tb $dir/mm.tb", "5625:6:7");
+check_file(-s "$dir/mm.tb", "Tablebase $dir/mm.tb not saved");
+run_test("-r mm -s optimal -tb $dir/mm.tb", "5625:6:7");
+
+# Journal an optimal search to a checkpoint file, then cut the journal
+# as if the search had been interrupted while writing it, and resume.
+run_test("-r mm -s optimal -O 3 -ckpt $dir/mm.ckpt", "5625:6:1");
+if (open(my $in, '<', "$dir/mm.ckpt"))
+{
+	my @lines = <$in>;
+	close($in);
+	check_file(@lines > 2, "Checkpoint $dir/mm.ckpt has no entries");
+	my $keep = int(@lines / 2);
+	my $partial = substr($lines[$keep], 0, 5);
+	open(my $out, '>', "$dir/mm.ckpt") or die "cannot write $dir/mm.ckpt";
+	print $out @lines[0 .. $keep - 1], $partial;
+	close($out);
+}
+else
+{
+	check_file(0, "Checkpoint $dir/mm.ckpt not written");
+}
+run_test("-r mm -s optimal -O 3 -ckpt $dir/mm.ckpt", "5625:6:1");
+
+# Distribute an optimal search over a job directory, with one worker.
+my $jobs = "$dir/jobs";
+mkdir($jobs) or die "cannot create $jobs";
+my $pid = fork();
+die "cannot fork" unless defined($pid);
+if ($pid == 0)
+{
+	exec($exec, "-S", "-q", "-r", "mm", "-s", "optimal", "-worker", $jobs, "60");
+	exit 127;
+}
+run_test("-r mm -s optimal -jobs $jobs 60", "5625:6:7");
+waitpid($pid, 0);
+check_file($? == 0, "Worker exited with status $?");
+
+# Restart the search after a worker died while solving the first job
+# (initial guess 0000, response 0); the job must be requeued.
+unlink("$jobs/g0-r0.done");
+if (open(my $out, '>', "$jobs/g0-r0.run"))
+{
+	print $out "ffff0000 0\n";
+	close($out);
+}
+run_test("-r mm -s optimal -jobs $jobs 60", "5625:6:7");
+check_file(-e "$jobs/g0-r0.done", "Job g0-r0 not requeued");
+
+# A worker gives up if no jobs are posted.
+mkdir("$dir/nojobs");
+check_file(system("$exec -S -q -r mm -s optimal -worker $dir/nojobs 1 2>/dev/null") != 0,
+	"Worker did not fail without jobs");
+
 # Display summary.
 print "\n" if $last_is_ok;
 if ($failed == 0)